@@ -0,0 +1,79 @@
+# Copyright 2026. The Regents of the University of California.
+# All rights reserved. Use of this source code is governed by
+# a BSD-style license which can be found in the LICENSE file.
+#
+# In-process access to libbart.so (make SHARED=1 libbart.so).
+# Arrays are passed by pointer with their strides, without copies
+# or files, and the GIL is released while the library computes.
+
+
+import os
+import ctypes as ct
+import numpy as np
+
+
+class mslr_conf(ct.Structure):
+    _fields_ = [("maxiter", ct.c_int),
+                ("rho", ct.c_float),
+                ("blkskip", ct.c_int),
+                ("initblk", ct.c_long),
+                ("mflags", ct.c_ulong),
+                ("flags", ct.c_ulong),
+                ("randshift", ct.c_bool),
+                ("noise", ct.c_bool),
+                ("completion", ct.c_bool),
+                ("hogwild", ct.c_bool),
+                ("remove_mean", ct.c_int),
+                ("check_every", ct.c_uint),
+                ("tol", ct.c_double),
+                ("prune_after", ct.c_int)]
+
+
+def _load():
+    path = os.environ.get("TOOLBOX_PATH", os.path.join(os.path.dirname(__file__), ".."))
+    lib = ct.CDLL(os.path.join(path, "libbart.so"))	# CDLL releases the GIL during calls
+
+    lp = ct.POINTER(ct.c_long)
+    lib.mslr_levels.argtypes = [ct.POINTER(mslr_conf), ct.c_uint, lp]
+    lib.mslr_levels.restype = ct.c_int
+    lib.mslr_decompose.argtypes = [ct.POINTER(mslr_conf), ct.c_uint, lp, lp, ct.c_void_p, lp, ct.c_void_p]
+    lib.mslr_decompose.restype = ct.c_int
+    return lib
+
+_lib = None
+
+
+def lrdecompose(x, maxiter=100, rho=0.25, blkskip=2, initblk=1, mflags=1, flags=~0,
+                randshift=True, noise=False, completion=False, hogwild=False,
+                remove_mean=0, check_every=0, tol=0., prune_after=0, out=None):
+    """Multi-scale low rank decomposition of x (as 'bart lrmatrix -a').
+    Returns an array with the levels in an extra last dimension."""
+    global _lib
+    if _lib is None:
+        _lib = _load()
+
+    if x.dtype != np.complex64:
+        x = x.astype(np.complex64)
+
+    conf = mslr_conf(maxiter, rho, blkskip, initblk, mflags, flags & ((1 << 64) - 1),
+                     randshift, noise, completion, hogwild, remove_mean, check_every, tol, prune_after)
+
+    D = x.ndim
+    dims = (ct.c_long * D)(*x.shape)
+
+    levels = _lib.mslr_levels(ct.byref(conf), D, dims)
+    if levels < 0:
+        raise ValueError("unsupported dimensions")
+
+    if out is None:
+        out = np.empty(x.shape + (levels,), dtype=np.complex64, order='F')
+    elif out.shape != x.shape + (levels,) or out.dtype != np.complex64:
+        raise ValueError("output array does not match")
+
+    istrs = (ct.c_long * D)(*x.strides)
+    ostrs = (ct.c_long * (D + 1))(*out.strides)
+
+    if 0 != _lib.mslr_decompose(ct.byref(conf), D, dims, ostrs, out.ctypes.data, istrs, x.ctypes.data):
+        raise RuntimeError("decomposition failed")
+
+    return out
@@ -0,0 +1,102 @@
+#!/bin/bash
+# Copyright 2026. The Regents of the University of California.
+# All rights reserved. Use of this source code is governed by
+# a BSD-style license which can be found in the LICENSE file.
+#
+# Iterations to quality and wall time of the multi-scale low rank
+# decomposition with random block shifts and with cycle spinning.
+# Each mode is compared to its own result after many iterations.
+#
+set -e
+
+SHIFTS=4
+REFITER=500
+ITERS="10 20 50 100 200"
+OPTS="-d -H -m 3 -f 3 -p 0.5 -a"
+
+helpstr=$(cat <<- EOF
+-s shifts	shifts per iteration for cycle spinning (default: 4)
+-r refiter	iterations of the reference results (default: 500)
+-i "iters"	iterations to compare (default: "$ITERS")
+-o opts		lrmatrix options (default: "$OPTS")
+-h		help
+EOF
+)
+
+usage="Usage: $0 [-h] [-s shifts] [-r refiter] [-i iters] [-o opts] <input>"
+
+while getopts "hs:r:i:o:" opt; do
+	case $opt in
+	h)
+		echo "$usage"
+		echo
+		echo "$helpstr"
+		exit 0
+	;;
+	s)
+		SHIFTS=$OPTARG
+	;;
+	r)
+		REFITER=$OPTARG
+	;;
+	i)
+		ITERS=$OPTARG
+	;;
+	o)
+		OPTS=$OPTARG
+	;;
+	\?)
+		echo "$usage" >&2
+		exit 1
+	;;
+	esac
+done
+
+shift $(($OPTIND -1 ))
+
+if [ $# -lt 1 ] ; then
+
+	echo "$usage" >&2
+	exit 1
+fi
+
+if [ ! -e $TOOLBOX_PATH/bart ] ; then
+	echo "\$TOOLBOX_PATH is not set correctly!" >&2
+	exit 1
+fi
+
+input=$(readlink -f "$1")
+
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+cd $WORKDIR
+
+# run <name> <iter> <extra options>, prints the wall time in seconds
+run()
+{
+	local start=$(date +%s.%N)
+	$TOOLBOX_PATH/bart lrmatrix $OPTS -i $2 $3 $input $1 > /dev/null
+	local end=$(date +%s.%N)
+	awk "BEGIN { printf \"%.2f\", $end - $start }"
+}
+
+MODES=("random" "spin$SHIFTS")
+FLAGS=("" "-C $SHIFTS")
+
+for m in 0 1; do
+
+	run ref_${MODES[$m]} $REFITER "${FLAGS[$m]}" > /dev/null
+done
+
+echo "# reference results differ by $($TOOLBOX_PATH/bart nrmse ref_random ref_spin$SHIFTS)"
+echo "# mode	iter	time	nrmse"
+
+for m in 0 1; do
+
+	for i in $ITERS; do
+
+		T=$(run out $i "${FLAGS[$m]}")
+
+		echo -e "${MODES[$m]}\t$i\t$T\t$($TOOLBOX_PATH/bart nrmse ref_${MODES[$m]} out)"
+	done
+done
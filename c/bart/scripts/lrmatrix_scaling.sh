@@ -0,0 +1,109 @@
+#!/bin/bash
+# Copyright 2026. The Regents of the University of California.
+# All rights reserved. Use of this source code is governed by
+# a BSD-style license which can be found in the LICENSE file.
+#
+# Strong and weak scaling of the distributed multi-scale low rank
+# decomposition (bart built with MPI=1).
+#
+set -e
+
+MAXPROC=4
+ITER=30
+OPTS="-d -H -m 3 -f 3 -p 0.5 -a"
+MPIRUN="mpirun"
+
+helpstr=$(cat <<- EOF
+-p maxproc	largest number of processes (default: 4)
+-i iter		number of iterations (default: 30)
+-o opts		lrmatrix options (default: "$OPTS")
+-r mpirun	MPI launcher (default: mpirun)
+-h		help
+EOF
+)
+
+usage="Usage: $0 [-h] [-p maxproc] [-i iter] [-o opts] [-r mpirun] <input>"
+
+while getopts "hp:i:o:r:" opt; do
+	case $opt in
+	h)
+		echo "$usage"
+		echo
+		echo "$helpstr"
+		exit 0
+	;;
+	p)
+		MAXPROC=$OPTARG
+	;;
+	i)
+		ITER=$OPTARG
+	;;
+	o)
+		OPTS=$OPTARG
+	;;
+	r)
+		MPIRUN=$OPTARG
+	;;
+	\?)
+		echo "$usage" >&2
+		exit 1
+	;;
+	esac
+done
+
+shift $(($OPTIND -1 ))
+
+if [ $# -lt 1 ] ; then
+
+	echo "$usage" >&2
+	exit 1
+fi
+
+if [ ! -e $TOOLBOX_PATH/bart ] ; then
+	echo "\$TOOLBOX_PATH is not set correctly!" >&2
+	exit 1
+fi
+
+input=$(readlink -f "$1")
+
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+cd $WORKDIR
+
+export OMP_NUM_THREADS=1
+
+run()
+{
+	$MPIRUN -np $1 $TOOLBOX_PATH/bart lrmatrix $OPTS -i $ITER $2 out 2>&1 | grep "Total Time" | head -n1 | awk '{ print $3 }'
+}
+
+echo "# strong scaling: same input"
+echo "# procs	time	speedup"
+
+for ((p = 1; p <= MAXPROC; p *= 2)); do
+
+	T=$(run $p $input)
+
+	if [ $p -eq 1 ] ; then
+		T1=$T
+	fi
+
+	echo -e "$p\t$T\t$(awk "BEGIN { printf \"%.2f\", $T1 / $T }")"
+done
+
+echo "# weak scaling: input repeated along dimension 1 for each process"
+echo "# procs	time	efficiency"
+
+for ((p = 1; p <= MAXPROC; p *= 2)); do
+
+	files=$(for ((k = 0; k < p; k++)); do echo -n "$input "; done)
+	$TOOLBOX_PATH/bart join 1 $files weak
+
+	T=$(run $p weak)
+
+	if [ $p -eq 1 ] ; then
+		W1=$T
+	fi
+
+	echo -e "$p\t$T\t$(awk "BEGIN { printf \"%.2f\", $W1 / $T }")"
+done
@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <complex.h>
+#include <math.h>
 #include <string.h>
 #include <stdbool.h>
 #include <unistd.h>
@@ -21,6 +22,12 @@
 #include "num/rand.h"
 #include "num/init.h"
 #include "num/ops.h"
+#include "num/casorati.h"
+#include "num/fft.h"
+
+#include "iter/vec.h"
+
+#include "noncart/grid.h"
 
 #include "wavelet2/wavelet.h"
 #include "wavelet3/wavthresh.h"
@@ -238,6 +245,13 @@ static double bench_batch_matmul2(long scale)
 }
 
 
+static double bench_fmac(long scale)
+{
+	long dims[DIMS] = { 4194304 * scale, 1, 1, 1, 1, 1, 1, 1 };
+	return bench_generic_matrix_multiply(dims);
+}
+
+
 static double bench_tall_matmul1(long scale)
 {
 	long dims[DIMS] = { 1, 8, 8, 100000 * scale, 1, 1, 1, 1 };
@@ -397,6 +411,384 @@ static double bench_zl1norm(long scale)
 }
 
 
+enum bench_vecop { VEC_DOT, VEC_NORM, VEC_AXPY, VEC_XPAY, VEC_SMUL, VEC_ADD, VEC_SUB, VEC_COPY, VEC_CLEAR, VEC_SWAP };
+
+/*
+ * Vector operations of the iterative algorithms,
+ * as selected by select_vecops (see BART_VECOPS)
+ */
+static double bench_vecops(int op, long scale)
+{
+	long N = 2 * 256 * 256 * 16 * scale * scale;
+
+	const struct vec_iter_s* vops = select_vecops(NULL);
+
+	float* x = vops->allocate(N);
+	float* y = vops->allocate(N);
+	float* z = vops->allocate(N);
+
+	md_gaussian_rand(1, MD_DIMS(N / 2), (complex float*)x);
+	md_gaussian_rand(1, MD_DIMS(N / 2), (complex float*)y);
+
+	double tic = timestamp();
+
+	switch (op) {
+	case VEC_DOT:
+		vops->dot(N, x, y);
+		break;
+	case VEC_NORM:
+		vops->norm(N, x);
+		break;
+	case VEC_AXPY:
+		vops->axpy(N, y, 0.5, x);
+		break;
+	case VEC_XPAY:
+		vops->xpay(N, 0.5, y, x);
+		break;
+	case VEC_SMUL:
+		vops->smul(N, 0.5, z, x);
+		break;
+	case VEC_ADD:
+		vops->add(N, z, x, y);
+		break;
+	case VEC_SUB:
+		vops->sub(N, z, x, y);
+		break;
+	case VEC_COPY:
+		vops->copy(N, z, x);
+		break;
+	case VEC_CLEAR:
+		vops->clear(N, z);
+		break;
+	case VEC_SWAP:
+		vops->swap(N, x, y);
+		break;
+	}
+
+	double toc = timestamp();
+
+	vops->del(x);
+	vops->del(y);
+	vops->del(z);
+
+	return toc - tic;
+}
+
+
+enum bench_iter { ITER_ADMM, ITER_ADMM_FUSED, ITER_CG, ITER_CG_FUSED };
+
+/*
+ * Vector operations of one iteration of ADMM (fast path, two
+ * functions as in lrmatrix) and CG, without the operators, either
+ * as separate operations or fused. This is limited by memory
+ * bandwidth: per element of x, ADMM streams 25 vectors separately
+ * (clear 1, sub 6, two adds 6, adds and subs 12) and 17 fused;
+ * CG 12 and 10.
+ */
+static double bench_iter_vecops(int op, long scale)
+{
+	bool cg = (ITER_CG == op) || (ITER_CG_FUSED == op);
+	bool fused = (ITER_ADMM_FUSED == op) || (ITER_CG_FUSED == op);
+
+	long N = 2 * 256 * 256 * 16 * scale * scale;
+	long M = 2 * N;
+
+	const struct vec_iter_s* vops = select_vecops(NULL);
+
+	float* x = vops->allocate(N);
+	float* s = vops->allocate(N);
+	float* p = vops->allocate(N);
+	float* z = vops->allocate(M);
+	float* u = vops->allocate(M);
+	float* r = vops->allocate(M);
+	float* g = vops->allocate(N);
+
+	md_gaussian_rand(1, MD_DIMS(N / 2), (complex float*)x);
+	md_gaussian_rand(1, MD_DIMS(N / 2), (complex float*)s);
+	md_gaussian_rand(1, MD_DIMS(N / 2), (complex float*)p);
+	md_gaussian_rand(1, MD_DIMS(M / 2), (complex float*)z);
+	md_gaussian_rand(1, MD_DIMS(M / 2), (complex float*)u);
+	md_gaussian_rand(1, MD_DIMS(M / 2), (complex float*)r);
+	md_gaussian_rand(1, MD_DIMS(N / 2), (complex float*)g);
+
+	double tic = timestamp();
+
+	if (!cg) {
+
+		// x: rhs, s: adjoint of r_j, g: G_j x
+		if (!fused) {
+
+			vops->clear(N, x);
+			vops->sub(M, r, z, u);
+			vops->add(N, x, x, s);
+			vops->add(N, x, x, s);
+
+		} else {
+
+			vops->add(N, x, x, s);
+		}
+
+		for (int j = 0; j < 2; j++) {
+
+			vops->add(N, g, g, u + j * N);
+
+			if (!fused)
+				vops->sub(N, u + j * N, g, z + j * N);
+			else
+				vops->dual_resid(N, u + j * N, r + j * N, g, z + j * N);
+		}
+
+	} else {
+
+		// s: r, p: p, g: Ap
+		if (!fused) {
+
+			float alpha = 0.5 / vops->dot(N, p, g);
+
+			vops->axpy(N, x, alpha, p);
+			vops->axpy(N, s, -alpha, g);
+
+			float beta = pow(vops->norm(N, s), 2.);
+
+			vops->xpay(N, beta, p, s);
+
+		} else {
+
+			float alpha = 0.5 / vops->dot(N, p, g);
+			float beta = pow(vops->axpy_norm(N, s, -alpha, g), 2.);
+
+			vops->axpy_xpay(N, x, alpha, p, beta, s);
+		}
+	}
+
+	double toc = timestamp();
+
+	vops->del(x);
+	vops->del(s);
+	vops->del(p);
+	vops->del(z);
+	vops->del(u);
+	vops->del(r);
+	vops->del(g);
+
+	return toc - tic;
+}
+
+
+/*
+ * Repeated 2D transforms of a multi-coil image as in the
+ * iterations of pics or nlinv. Without the cache, each
+ * transform is planned again (as before plans were cached).
+ */
+static double bench_fft_repeated(int cached, long scale)
+{
+	long dims[DIMS] = { 128 * scale, 128 * scale, 1, 8, 1, 1, 1, 1 };
+
+	complex float* x = md_alloc(DIMS, dims, CFL_SIZE);
+	complex float* y = md_alloc(DIMS, dims, CFL_SIZE);
+
+	md_gaussian_rand(DIMS, dims, x);
+
+	fft_cache_clear();
+
+	double tic = timestamp();
+
+	for (int i = 0; i < 20; i++) {
+
+		if (!cached)
+			fft_cache_clear();
+
+		fftuc(DIMS, dims, 3, y, x);
+		ifftuc(DIMS, dims, 3, x, y);
+	}
+
+	double toc = timestamp();
+
+	md_free(x);
+	md_free(y);
+
+	return toc - tic;
+}
+
+
+/*
+ * Gridding of radial multi-coil data (256 spokes with 512 samples)
+ * onto a twofold oversampled grid as in the nufft operator.
+ */
+static double bench_generic_grid(bool interp, long scale)
+{
+	long S = 512 * scale;
+	long ksp_dims[4] = { 1, S, 256, 8 };
+	long grid_dims[4] = { S, S, 1, 8 };
+
+	complex float* traj = md_alloc(3, MD_DIMS(3, S, 256), CFL_SIZE);
+
+	for (long j = 0; j < 256; j++) {
+
+		for (long i = 0; i < S; i++) {
+
+			float r = (float)(i - S / 2) / 2.;
+			float phi = M_PI * j / 256.;
+
+			traj[(j * S + i) * 3 + 0] = r * cosf(phi);
+			traj[(j * S + i) * 3 + 1] = r * sinf(phi);
+			traj[(j * S + i) * 3 + 2] = 0.;
+		}
+	}
+
+	complex float* ksp = md_alloc(4, ksp_dims, CFL_SIZE);
+	complex float* grd = md_alloc(4, grid_dims, CFL_SIZE);
+
+	md_gaussian_rand(4, ksp_dims, ksp);
+	md_gaussian_rand(4, grid_dims, grd);
+
+	double beta = calc_beta(2., 3.);
+
+	double tic = timestamp();
+
+	if (interp)
+		gridH(2., 3., beta, traj, ksp_dims, ksp, grid_dims, grd);
+	else
+		grid(2., 3., beta, traj, grid_dims, grd, ksp_dims, ksp);
+
+	double toc = timestamp();
+
+	md_free(traj);
+	md_free(ksp);
+	md_free(grd);
+
+	return toc - tic;
+}
+
+static double bench_grid(long scale)
+{
+	return bench_generic_grid(false, scale);
+}
+
+static double bench_gridH(long scale)
+{
+	return bench_generic_grid(true, scale);
+}
+
+
+/*
+ * Data movement of lrthresh for one level: reshape the circularly
+ * extended and shifted image into a block matrix and back.
+ *
+ * md_*: md_circ_ext, md_circ_shift, basorati_matrix and back
+ * basorati_matrixH, md_circ_shift, md_resize (six passes each way)
+ *
+ * fused: one gather and one scatter per block
+ */
+static double bench_generic_blocks(long dims[DIMS], long blkdims[DIMS], bool fused)
+{
+	long zdims[DIMS];
+	long shift[DIMS];
+
+	for (unsigned int i = 0; i < DIMS; i++) {
+
+		zdims[i] = ((dims[i] + blkdims[i] - 1) / blkdims[i]) * blkdims[i];
+		shift[i] = (blkdims[i] - 1) / 2;
+	}
+
+	long strs[DIMS];
+	long zstrs[DIMS];
+
+	md_calc_strides(DIMS, strs, dims, CFL_SIZE);
+	md_calc_strides(DIMS, zstrs, zdims, CFL_SIZE);
+
+	long mdims[2];
+	basorati_dims(DIMS, mdims, blkdims, zdims);
+
+	complex float* x = md_alloc(DIMS, dims, CFL_SIZE);
+	complex float* y = md_alloc(DIMS, dims, CFL_SIZE);
+	complex float* ext = md_alloc(DIMS, zdims, CFL_SIZE);
+	complex float* tmp = md_alloc(DIMS, zdims, CFL_SIZE);
+	complex float* mat = md_alloc(2, mdims, CFL_SIZE);
+
+	long idx_size = 0;
+
+	for (unsigned int i = 0; i < DIMS; i++)
+		idx_size += 2 * zdims[i];
+
+	long* idx = xmalloc(idx_size * sizeof(long));
+	long* gidx[DIMS];
+	long* sidx[DIMS];
+
+	long* ptr = idx;
+
+	for (unsigned int i = 0; i < DIMS; i++) {
+
+		gidx[i] = ptr;
+		sidx[i] = ptr + zdims[i];
+		ptr += 2 * zdims[i];
+	}
+
+	md_gaussian_rand(DIMS, dims, x);
+
+	double tic = timestamp();
+
+	if (fused) {
+
+		basorati_circ_index(DIMS, gidx, sidx, zdims, shift, dims, strs);
+
+		long grid[DIMS];
+
+		for (unsigned int i = 0; i < DIMS; i++)
+			grid[i] = zdims[i] / blkdims[i];
+
+		long pos[DIMS] = { 0 };
+
+		do {
+			basorati_gather_block(DIMS, blkdims, pos, (const long**)gidx, mat, x);
+			basorati_scatter_block(DIMS, blkdims, pos, (const long**)sidx, y, mat);
+
+		} while (md_next(DIMS, grid, ~0u, pos));
+
+	} else {
+
+		long ushift[DIMS];
+
+		for (unsigned int i = 0; i < DIMS; i++)
+			ushift[i] = -shift[i];
+
+		md_circ_ext(DIMS, zdims, ext, dims, x, CFL_SIZE);
+		md_circ_shift(DIMS, zdims, shift, tmp, ext, CFL_SIZE);
+		basorati_matrix(DIMS, blkdims, mdims, mat, zdims, zstrs, tmp);
+
+		basorati_matrixH(DIMS, blkdims, zdims, zstrs, tmp, mdims, mat);
+		md_circ_shift(DIMS, zdims, ushift, ext, tmp, CFL_SIZE);
+		md_resize(DIMS, dims, y, zdims, ext, CFL_SIZE);
+	}
+
+	double toc = timestamp();
+
+	free(idx);
+	md_free(x);
+	md_free(y);
+	md_free(ext);
+	md_free(tmp);
+	md_free(mat);
+
+	return toc - tic;
+}
+
+
+static double bench_blocks_md(long scale)
+{
+	long dims[DIMS] = { 1, 250 * scale, 250 * scale, 1, 1, 16, 1, 1 };
+	long blkdims[DIMS] = { 1, 8, 8, 1, 1, 16, 1, 1 };
+	return bench_generic_blocks(dims, blkdims, false);
+}
+
+static double bench_blocks_fused(long scale)
+{
+	long dims[DIMS] = { 1, 250 * scale, 250 * scale, 1, 1, 16, 1, 1 };
+	long blkdims[DIMS] = { 1, 8, 8, 1, 1, 16, 1, 1 };
+	return bench_generic_blocks(dims, blkdims, true);
+}
+
+
 static double bench_wavelet_thresh(int version, long scale)
 {
 	long dims[DIMS] = { 1, 256 * scale, 256 * scale, 1, 16, 1, 1, 1 };
@@ -447,8 +839,9 @@ static double bench_wavelet3(long scale)
 enum bench_indices { REPETITION_IND, SCALE_IND, THREADS_IND, TESTS_IND, BENCH_DIMS };
 
 typedef double (*bench_fun)(long scale);
+typedef double (*bench_fun_op)(int op, long scale);
 
-static void do_test(const long dims[BENCH_DIMS], complex float* out, long scale, bench_fun fun, const char* str)
+static void do_test(const long dims[BENCH_DIMS], complex float* out, long scale, bench_fun fun, bench_fun_op fun_op, int op, const char* str)
 {
 	printf("%30.30s |", str);
 	
@@ -459,7 +852,7 @@ static void do_test(const long dims[BENCH_DIMS], complex float* out, long scale,
 
 	for (int i = 0; i < N; i++) {
 
-		double dt = fun(scale);
+		double dt = (NULL != fun) ? fun(scale) : fun_op(op, scale);
 		sum += dt;
 		min = MIN(dt, min);
 		max = MAX(dt, max);
@@ -494,6 +887,7 @@ const struct benchmark_s {
 	{ bench_batch_matmul2,	"batch matrix multiply 2" },
 	{ bench_tall_matmul1,	"tall matrix multiply 1" },
 	{ bench_tall_matmul2,	"tall matrix multiply 2" },
+	{ bench_fmac,		"fmac (md_zfmac2), contiguous" },
 	{ bench_zscalar,	"complex dot product" },
 	{ bench_zscalar,	"complex dot product" },
 	{ bench_zscalar_real,	"real complex dot product" },
@@ -501,8 +895,38 @@ const struct benchmark_s {
 	{ bench_zl1norm,	"l1 norm" },
 	{ bench_copy1,		"copy 1" },
 	{ bench_copy2,		"copy 2" },
+	{ bench_blocks_md,	"block matrix (md_*)" },
+	{ bench_blocks_fused,	"block matrix (fused)" },
 	{ bench_wavelet2,	"wavelet soft thresh" },
 	{ bench_wavelet3,	"wavelet soft thresh" },
+	{ bench_grid,		"gridding (radial, 8 coils)" },
+	{ bench_gridH,		"interpolation (gridH)" },
+};
+
+// parameterized benchmarks, one entry per operation
+const struct benchmark_op_s {
+
+	bench_fun_op fun;
+	int op;
+	const char* str;
+
+} benchmarks_op[] = {
+	{ bench_vecops,	VEC_DOT,	"vecops dot" },
+	{ bench_vecops,	VEC_NORM,	"vecops norm" },
+	{ bench_vecops,	VEC_AXPY,	"vecops axpy" },
+	{ bench_vecops,	VEC_XPAY,	"vecops xpay" },
+	{ bench_vecops,	VEC_SMUL,	"vecops smul" },
+	{ bench_vecops,	VEC_ADD,	"vecops add" },
+	{ bench_vecops,	VEC_SUB,	"vecops sub" },
+	{ bench_vecops,	VEC_COPY,	"vecops copy" },
+	{ bench_vecops,	VEC_CLEAR,	"vecops clear" },
+	{ bench_vecops,	VEC_SWAP,	"vecops swap" },
+	{ bench_iter_vecops,	ITER_ADMM,	"admm iteration vecops" },
+	{ bench_iter_vecops,	ITER_ADMM_FUSED,	"admm iteration vecops (fused)" },
+	{ bench_iter_vecops,	ITER_CG,	"cg iteration vecops" },
+	{ bench_iter_vecops,	ITER_CG_FUSED,	"cg iteration vecops (fused)" },
+	{ bench_fft_repeated,	0,	"repeated fft (replanned)" },
+	{ bench_fft_repeated,	1,	"repeated fft (cached plans)" },
 };
 
 
@@ -566,7 +990,10 @@ int main_bench(int argc, char* argv[])
 	dims[REPETITION_IND] = 5;
 	dims[THREADS_IND] = threads ? 8 : 1;
 	dims[SCALE_IND] = scaling ? 5 : 1;
-	dims[TESTS_IND] = sizeof(benchmarks) / sizeof(benchmarks[0]);
+	long N1 = sizeof(benchmarks) / sizeof(benchmarks[0]);
+	long N2 = sizeof(benchmarks_op) / sizeof(benchmarks_op[0]);
+
+	dims[TESTS_IND] = N1 + N2;
 
 	md_calc_strides(BENCH_DIMS, strs, dims, CFL_SIZE);
 
@@ -582,8 +1009,13 @@ int main_bench(int argc, char* argv[])
 			debug_printf(DP_INFO, "%02d threads. ", pos[THREADS_IND] + 1);
 		}
 
-		do_test(dims, &MD_ACCESS(BENCH_DIMS, strs, pos, out), pos[SCALE_IND] + 1,
-			benchmarks[pos[TESTS_IND]].fun, benchmarks[pos[TESTS_IND]].str);
+		long t = pos[TESTS_IND];
+		complex float* o = &MD_ACCESS(BENCH_DIMS, strs, pos, out);
+
+		if (t < N1)
+			do_test(dims, o, pos[SCALE_IND] + 1, benchmarks[t].fun, NULL, 0, benchmarks[t].str);
+		else
+			do_test(dims, o, pos[SCALE_IND] + 1, NULL, benchmarks_op[t - N1].fun, benchmarks_op[t - N1].op, benchmarks_op[t - N1].str);
 
 	} while (md_next(BENCH_DIMS, dims, ~MD_BIT(REPETITION_IND), pos));
 
@@ -27,6 +27,7 @@
 
 #include "misc/debug.h"
 #include "misc/misc.h"
+#include "misc/trace.h"
 
 #include "iter/italgos.h"
 #include "iter/iter.h"
@@ -142,11 +143,18 @@ void admm(struct admm_history_s* history, const struct admm_plan_s* plan,
 	float* GH_usum = NULL;
 	float* zj_old = NULL;
 
+	// in fast mode, residuals are only computed every check_every iterations
+	unsigned int check_every = fast ? plan->check_every : 1;
+	double obj_last = 0.;
 
 	if (!fast) {
 
 		GH_usum = vops->allocate(N);
 		zj_old = vops->allocate(Mjmax);
+
+	} else if (check_every > 0) {
+
+		GH_usum = vops->allocate(N);
 	}
 
 
@@ -182,6 +190,9 @@ void admm(struct admm_history_s* history, const struct admm_plan_s* plan,
 
 	unsigned int grad_iter = 0; // keep track of number of gradient evaluations
 
+	// r = z - u is kept from the dual update of the last iteration
+	bool r_valid = false;
+
 	if (plan->do_warmstart) {
 
 		for (unsigned int j = 0; j < num_funs; j++) {
@@ -209,15 +220,29 @@ void admm(struct admm_history_s* history, const struct admm_plan_s* plan,
 
 	for (unsigned int i = 0; i < plan->maxiter; i++) {
 
+		// one trace event per iteration, closed here or after the loop
+		if (0 < i)
+			TRACE_END(0., 0., "admm iter");
+
+		TRACE_BEGIN();
+
 		// update x
-		vops->clear(N, rhs);
-		vops->sub(M, r, z, u);
+		if (!r_valid)
+			vops->sub(M, r, z, u);
 
 		for (unsigned int j = 0; j < num_funs; j++) {
 
 			pos = md_calc_offset(j, fake_strs, z_dims);
-			plan->ops[j].adjoint(plan->ops[j].data, s, r + pos);
-			vops->add(N, rhs, rhs, s);
+
+			if (0 == j) {
+
+				plan->ops[j].adjoint(plan->ops[j].data, rhs, r + pos);
+
+			} else {
+
+				plan->ops[j].adjoint(plan->ops[j].data, s, r + pos);
+				vops->add(N, rhs, rhs, s);
+			}
 		}
 
 
@@ -261,8 +286,15 @@ void admm(struct admm_history_s* history, const struct admm_plan_s* plan,
 
 
 		double n1 = 0.;
+		double r2 = 0.;
+		double dz2 = 0.;
 
-		if (!fast) {
+		bool check = fast && (check_every > 0) && (0 == (i + 1) % check_every);
+
+		// fused dual update and residual for the next iteration
+		r_valid = fast && !check;
+
+		if (!fast || check) {
 
 			vops->clear(N, GH_usum);
 			vops->clear(N, s);
@@ -291,6 +323,12 @@ void admm(struct admm_history_s* history, const struct admm_plan_s* plan,
 				vops->axpy(Mj, Gjx_plus_uj, (1. - plan->alpha), z + pos);
 			}
 
+			if (check) {
+
+				n1 = n1 + vops->dot(Mj, Gjx_plus_uj, Gjx_plus_uj);
+				vops->copy(Mj, r + pos, z + pos); // r is free here, keep zj_old
+			}
+
 			vops->add(Mj, Gjx_plus_uj, Gjx_plus_uj, u + pos); // Gj(x) + uj
 
 			if (0 == rho)
@@ -298,7 +336,10 @@ void admm(struct admm_history_s* history, const struct admm_plan_s* plan,
 			else
 				plan->prox_ops[j].prox_fun(plan->prox_ops[j].data, 1. / rho, z + pos, Gjx_plus_uj);
 
-			vops->sub(Mj, u + pos, Gjx_plus_uj, z + pos);
+			if (r_valid)
+				vops->dual_resid(Mj, u + pos, r + pos, Gjx_plus_uj, z + pos);
+			else
+				vops->sub(Mj, u + pos, Gjx_plus_uj, z + pos);
 
 			if (!fast) {
 
@@ -315,6 +356,22 @@ void admm(struct admm_history_s* history, const struct admm_plan_s* plan,
 				vops->add(N, GH_usum, GH_usum, rhs);
 			}
 
+			if (check) {
+
+				// s = s + Gj^H (zj - zj_old)
+				vops->sub(Mj, r + pos, z + pos, r + pos);
+				dz2 = dz2 + vops->dot(Mj, r + pos, r + pos);
+				plan->ops[j].adjoint(plan->ops[j].data, rhs, r + pos);
+				vops->add(N, s, s, rhs);
+
+				plan->ops[j].adjoint(plan->ops[j].data, rhs, u + pos);
+				vops->add(N, GH_usum, GH_usum, rhs);
+
+				// rj = Gj(x) - zj (one extra forward instead of keeping a copy)
+				plan->ops[j].forward(plan->ops[j].data, Gjx_plus_uj, x);
+				vops->sub(Mj, Gjx_plus_uj, Gjx_plus_uj, z + pos);
+				r2 = r2 + vops->dot(Mj, Gjx_plus_uj, Gjx_plus_uj);
+			}
 		}
 
 		history->rho[i] = rho;
@@ -366,6 +423,44 @@ void admm(struct admm_history_s* history, const struct admm_plan_s* plan,
 				}
 			}
 
+		} else if (check) {
+
+			history->s_norm[i] = rho * vops->norm(N, s);
+			history->r_norm[i] = sqrt(r2);
+
+			n1 = sqrt(n1);
+			double n2 = vops->norm(M, z);
+			history->eps_pri[i] = ABSTOL * sqrt(M) + RELTOL * (n1 > n2 ? n1 : n2);
+			history->eps_dual[i] = ABSTOL * sqrt(N) + RELTOL * rho * vops->norm(N, GH_usum);
+
+			// change of z in this iteration (not since the last check)
+			double dz = (n2 > 0.) ? (sqrt(dz2) / n2) : 0.;
+
+			// evaluate again after the prox, whose side results
+			// (e.g. nuclear norms) would otherwise lag by one iteration
+			if ((NULL != obj_eval) && (NULL != obj_eval_data))
+				history->objective[i] = obj_eval(obj_eval_data, x);
+
+			double obj = history->objective[i];
+			double dobj = (obj_last != 0.) ? (fabs(obj - obj_last) / fabs(obj_last)) : 1.;
+
+			obj_last = obj;
+
+			debug_printf(DP_DEBUG3, "### ITER: %d (%d) r: %.4e (%.4e) s: %.4e (%.4e) dz: %.4e dobj: %.4e\n",
+					i, grad_iter, history->r_norm[i], history->eps_pri[i],
+					history->s_norm[i], history->eps_dual[i], dz, dobj);
+
+			if ((grad_iter > plan->maxiter)
+			    || ((history->r_norm[i] < history->eps_pri[i])
+				&& (history->s_norm[i] < history->eps_dual[i]))
+			    || ((plan->tol > 0.) && (dz < plan->tol))
+			    || ((plan->tol > 0.) && (NULL != obj_eval) && (dobj < plan->tol))) {
+
+				debug_printf(DP_DEBUG2, "ADMM converged after %d iterations.\n", i + 1);
+				history->numiter = i;
+				break;
+			}
+
 		} else {
 
 			debug_printf(DP_DEBUG3, "### ITER: %d (%d)\n", i, grad_iter);
@@ -384,11 +479,15 @@ void admm(struct admm_history_s* history, const struct admm_plan_s* plan,
 				rho *= 2.;
 				hw_K *= 2;
 				vops->smul(M, 0.5, u, u);
+				r_valid = false;
 			}
 		}
 
 	}
 
+	if (0 < plan->maxiter)
+		TRACE_END(0., 0., "admm iter");
+
 
 	// cleanup
 	vops->del(z);
@@ -398,11 +497,11 @@ void admm(struct admm_history_s* history, const struct admm_plan_s* plan,
 	vops->del(r);
 	vops->del(s);
 
-	if (!fast) {
-
+	if (NULL != GH_usum)
 		vops->del(GH_usum);
+
+	if (NULL != zj_old)
 		vops->del(zj_old);
-	}
 
 	if (NULL != plan->image_truth)
 		vops->del(x_err);
@@ -47,6 +47,9 @@ struct admm_prox_op {
  *
  * @param ABSTOL used for early stopping condition
  * @param RELTOL used for early stopping condition
+ * @param check_every in fast mode, compute residuals and test for convergence every check_every iterations (0: never)
+ * @param tol in fast mode, also stop if the relative change of z in the last iteration
+ *  or of the objective since the last test is below tol
  *
  * @param rho -- augmented lagrangian penalty parameter
  * @param alpha -- over-relaxation parameter between (0, 2)
@@ -74,6 +77,9 @@ struct admm_plan_s {
 	double ABSTOL;
 	double RELTOL;
 
+	unsigned int check_every;
+	double tol;
+
 	float rho;
 	float alpha;
 
@@ -475,29 +475,28 @@ float conjgrad(unsigned int maxiter, float l2lambda, float epsilon,
 		debug_printf(DP_DEBUG3, "#%d: %f\n", i, (double)sqrtf(rsnew));
 
 		linop(data, Ap, p);	// Ap = A p
-		vops->axpy(N, Ap, l2lambda, p);
 
-		float pAp = (float)vops->dot(N, p, Ap);
+		// Ap = Ap + l2lambda p and <p, Ap> in one pass
+		float pAp = (float)((0. != l2lambda) ? vops->axpy_dot(N, Ap, l2lambda, p) : vops->dot(N, p, Ap));
 
 		if (0. == pAp)
 			break;
 
 		float alpha = rsold / pAp;
 
-		vops->axpy(N, x, +alpha, p);
-		vops->axpy(N, r, -alpha, Ap);
-	
-		rsnew = (float)pow(vops->norm(N, r), 2.);
+		// r = r - alpha Ap and |r|^2 in one pass
+		rsnew = (float)pow(vops->axpy_norm(N, r, -alpha, Ap), 2.);
 		float beta = rsnew / rsold;
 		
 		rsold = rsnew;
 
 		if (rsnew <= eps_squared) {
 			//debug_printf(DP_DEBUG3, "%d ", i);
+			vops->axpy(N, x, +alpha, p);
 			break;
 		}
 
-		vops->xpay(N, beta, p, r);	// p = beta * p + r
+		vops->axpy_xpay(N, x, +alpha, p, beta, r);	// x = x + alpha * p, p = beta * p + r
 
 	}
 
@@ -573,24 +572,25 @@ float conjgrad_hist(struct iter_history_s* history, unsigned int maxiter, float
 		//debug_printf(DP_DEBUG3, "#%d: %f\n", i, (double)sqrtf(rsnew));
 
 		linop(data, Ap, p);	// Ap = A p
-		vops->axpy(N, Ap, l2lambda, p);
 
-		float alpha = rsold / (float)vops->dot(N, p, Ap);
+		// Ap = Ap + l2lambda p and <p, Ap> in one pass
+		float pAp = (float)((0. != l2lambda) ? vops->axpy_dot(N, Ap, l2lambda, p) : vops->dot(N, p, Ap));
 
-		vops->axpy(N, x, +alpha, p);
-		vops->axpy(N, r, -alpha, Ap);
-	
-		rsnew = (float)pow(vops->norm(N, r), 2.);
+		float alpha = rsold / pAp;
+
+		// r = r - alpha Ap and |r|^2 in one pass
+		rsnew = (float)pow(vops->axpy_norm(N, r, -alpha, Ap), 2.);
 		float beta = rsnew / rsold;
 		
 		rsold = rsnew;
 
 		if (rsnew <= eps_squared) {
 			//debug_printf(DP_DEBUG3, "%d ", i);
+			vops->axpy(N, x, +alpha, p);
 			break;
 		}
 
-		vops->xpay(N, beta, p, r);	// p = beta * p + r
+		vops->axpy_xpay(N, x, +alpha, p, beta, r);	// x = x + alpha * p, p = beta * p + r
 
 		history->resid[i] = sqrtf(rsnew);
 	}
@@ -696,24 +696,25 @@ float conjgrad_hist_prealloc(struct iter_history_s* history, unsigned int maxite
 		//debug_printf(DP_DEBUG3, "#%d: %f\n", i, (double)sqrtf(rsnew));
 
 		linop(data, Ap, p);	// Ap = A p
-		vops->axpy(N, Ap, l2lambda, p);
 
-		float alpha = rsold / (float)vops->dot(N, p, Ap);
+		// Ap = Ap + l2lambda p and <p, Ap> in one pass
+		float pAp = (float)((0. != l2lambda) ? vops->axpy_dot(N, Ap, l2lambda, p) : vops->dot(N, p, Ap));
+
+		float alpha = rsold / pAp;
 
-		vops->axpy(N, x, +alpha, p);
-		vops->axpy(N, r, -alpha, Ap);
-	
-		rsnew = (float)pow(vops->norm(N, r), 2.);
+		// r = r - alpha Ap and |r|^2 in one pass
+		rsnew = (float)pow(vops->axpy_norm(N, r, -alpha, Ap), 2.);
 		float beta = rsnew / rsold;
 		
 		rsold = rsnew;
 
 		if (rsnew <= eps_squared) {
 			//debug_printf(DP_DEBUG3, "%d ", i);
+			vops->axpy(N, x, +alpha, p);
 			break;
 		}
 
-		vops->xpay(N, beta, p, r);	// p = beta * p + r
+		vops->axpy_xpay(N, x, +alpha, p, beta, r);	// x = x + alpha * p, p = beta * p + r
 
 		history->resid[i] = sqrtf(rsnew);
 	}
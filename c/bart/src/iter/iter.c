@@ -91,6 +91,11 @@ const struct iter_admm_conf iter_admm_defaults = {
 
 	.tau = 2.,
 	.mu = 100,
+
+	.check_every = 0,
+	.tol = 0.,
+
+	.scratch = NULL,
 };
 
 
@@ -75,6 +75,10 @@ struct iter_admm_conf {
 	float mu;
 
 	_Bool fast;
+	unsigned int check_every;
+	double tol;
+
+	const char* scratch;	// keep iteration state in files in this directory
 };
 
 
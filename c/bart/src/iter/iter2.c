@@ -193,6 +193,8 @@ void iter2_admm(void* _conf,
 		.tau = conf->tau,
 		.mu = conf->mu,
 		.fast = conf->fast,
+		.check_every = conf->check_every,
+		.tol = conf->tol,
 	};
 
 
@@ -232,7 +234,9 @@ void iter2_admm(void* _conf,
 			goto cleanup;
 	}
 
-	admm(&admm_history, &admm_plan, admm_plan.num_funs, z_dims, size, (float*)image, image_adj, select_vecops(image), operator_iter, (void*)normaleq_op, obj_eval_data, obj_eval);
+	const struct vec_iter_s* vops = (NULL != conf->scratch) ? scratch_vecops(conf->scratch) : select_vecops(image);
+
+	admm(&admm_history, &admm_plan, admm_plan.num_funs, z_dims, size, (float*)image, image_adj, vops, operator_iter, (void*)normaleq_op, obj_eval_data, obj_eval);
 
 cleanup:
 	;
@@ -21,6 +21,7 @@
 #include "linops/linop.h"
 
 #include "iter/iter.h"
+#include "iter/vec.h"
 
 #include "misc/misc.h"
 
@@ -369,12 +370,14 @@ const struct operator_p_s* prox_zero_create(unsigned int N, const long dims[N])
  * @param op linop A
  * @param adj A^H y
  * @param tmp tmp
+ * @param vops allocator of adj and tmp (NULL: same place as y)
  */
 struct prox_lineq_data {
 	
 	const struct linop_s* op;
 	complex float* adj;
 	complex float* tmp;
+	const struct vec_iter_s* vops;
 };
 
 static void prox_lineq_apply(const void* _data, float mu, complex float* dst, const complex float* src)
@@ -392,12 +395,26 @@ static void prox_lineq_apply(const void* _data, float mu, complex float* dst, co
 static void prox_lineq_del(const void* _data)
 {
 	struct prox_lineq_data* pdata = (struct prox_lineq_data* )_data;
-	md_free(pdata->adj);
-	md_free(pdata->tmp);
+
+	if (NULL != pdata->vops) {
+
+		pdata->vops->del((float*)pdata->adj);
+		pdata->vops->del((float*)pdata->tmp);
+
+	} else {
+
+		md_free(pdata->adj);
+		md_free(pdata->tmp);
+	}
+
 	free(pdata);
 }
 
-const struct operator_p_s* prox_lineq_create(const struct linop_s* op, const complex float* y)
+/**
+ * Same as prox_lineq_create, but the two domain-sized buffers
+ * are allocated with vops (e.g. scratch_vecops for out-of-core).
+ */
+const struct operator_p_s* prox_lineq_create2(const struct linop_s* op, const complex float* y, const struct vec_iter_s* vops)
 {
 	struct prox_lineq_data* pdata = xmalloc(sizeof(struct prox_lineq_data));
 
@@ -405,15 +422,31 @@ const struct operator_p_s* prox_lineq_create(const struct linop_s* op, const com
 	const long* dims = linop_domain(op)->dims;
 
 	pdata->op = op;
+	pdata->vops = vops;
 
-	pdata->adj = md_alloc_sameplace(N, dims, CFL_SIZE, y);
-	linop_adjoint(op, N, dims, pdata->adj, N, linop_codomain(op)->dims, y);
+	if (NULL != vops) {
 
-	pdata->tmp = md_alloc_sameplace(N, dims, CFL_SIZE, y);
+		long size = 2 * md_calc_size(N, dims);
+
+		pdata->adj = (complex float*)vops->allocate(size);
+		pdata->tmp = (complex float*)vops->allocate(size);
+
+	} else {
+
+		pdata->adj = md_alloc_sameplace(N, dims, CFL_SIZE, y);
+		pdata->tmp = md_alloc_sameplace(N, dims, CFL_SIZE, y);
+	}
+
+	linop_adjoint(op, N, dims, pdata->adj, N, linop_codomain(op)->dims, y);
 
 	return operator_p_create(N, dims, N, dims, pdata, prox_lineq_apply, prox_lineq_del);
 }
 
+const struct operator_p_s* prox_lineq_create(const struct linop_s* op, const complex float* y)
+{
+	return prox_lineq_create2(op, y, NULL);
+}
+
 
 /**
  * Data for computing prox_ineq_fun: 
@@ -10,6 +10,7 @@
 
 struct operator_p_s;
 struct linop_s;
+struct vec_iter_s;
 
 
 extern const struct operator_p_s* prox_normaleq_create(const struct linop_s* op, const _Complex float* y);
@@ -17,6 +18,7 @@ extern const struct operator_p_s* prox_leastsquares_create(unsigned int N, const
 extern const struct operator_p_s* prox_l2ball_create(unsigned int N, const long dims[__VLA(N)], float eps, const _Complex float* center);
 extern const struct operator_p_s* prox_zero_create(unsigned int N, const long dims[__VLA(N)]);
 extern const struct operator_p_s* prox_lineq_create(const struct linop_s* op, const _Complex float* y);
+extern const struct operator_p_s* prox_lineq_create2(const struct linop_s* op, const _Complex float* y, const struct vec_iter_s* vops);
 extern const struct operator_p_s* prox_lesseq_create(unsigned int N, const long dims[__VLA(N)], const _Complex float* b);
 extern const struct operator_p_s* prox_greq_create(unsigned int N, const long dims[__VLA(N)], const _Complex float* b);
 extern const struct operator_p_s* prox_rvc_create(unsigned int N, const long dims[__VLA(N)]);
@@ -1,8 +1,14 @@
+#include <complex.h>
+#include <stdlib.h>
+#include <string.h>
+
 
 #include "num/vecops.h"
 #include "num/gpuops.h"
 
 #include "misc/misc.h"
+#include "misc/mmio.h"
+#include "misc/debug.h"
 
 #include "vec.h"
 
@@ -13,13 +19,84 @@
 
 
 
+/*
+ * Out-of-core vectors: same operations as on the CPU, but memory
+ * is mapped from temporary files so that the kernel can write it
+ * back and evict it under memory pressure. The length is stored
+ * in front of the data so that vectors can be unmapped.
+ */
+#define SCRATCH_HDR 512	// complex floats (one page)
+
+static const char* scratch_dir = NULL;
+static struct vec_iter_s scratch_iter_ops;
+
+static float* scratch_allocate(long N)
+{
+	long dims[1] = { SCRATCH_HDR + (N + 1) / 2 };
+	complex float* ptr = scratch_cfl(scratch_dir, 1, dims);
+
+	*(long*)ptr = N;
+
+	return (float*)(ptr + SCRATCH_HDR);
+}
+
+static void scratch_del(float* x)
+{
+	complex float* ptr = (complex float*)x - SCRATCH_HDR;
+	long dims[1] = { SCRATCH_HDR + (*(long*)ptr + 1) / 2 };
+
+	unmap_cfl(1, dims, ptr);
+}
+
+
+const struct vec_iter_s* scratch_vecops(const char* dir)
+{
+	scratch_dir = dir;
+	scratch_iter_ops = *select_vecops(NULL);
+	scratch_iter_ops.allocate = scratch_allocate;
+	scratch_iter_ops.del = scratch_del;
+
+	return &scratch_iter_ops;
+}
+
+
+/*
+ * Vector operations on the CPU, selected by the environment
+ * variable BART_VECOPS: "scalar" for the single-threaded loops,
+ * otherwise the parallel version with the kernels given by
+ * "generic", "avx2" or "avx512" (default: best supported).
+ */
+static const struct vec_iter_s* cpu_vecops(void)
+{
+	static const struct vec_iter_s* ops = NULL;
+
+	if (NULL == ops) {
+
+		const char* str = getenv("BART_VECOPS");
+
+		if ((NULL != str) && (0 == strcmp(str, "scalar"))) {
+
+			debug_printf(DP_DEBUG1, "Scalar vector operations\n");
+			ops = &cpu_iter_ops;
+
+		} else {
+
+			vecops_par_select(((NULL == str) || (0 == strcmp(str, "parallel"))) ? NULL : str);
+			ops = &cpu_par_iter_ops;
+		}
+	}
+
+	return ops;
+}
+
+
 const struct vec_iter_s* select_vecops(const float* x)
 {
 #ifdef USE_CUDA
-	return cuda_ondevice(x) ? &gpu_iter_ops : &cpu_iter_ops;
+	return ((NULL != x) && cuda_ondevice(x)) ? &gpu_iter_ops : cpu_vecops();
 #else
 	UNUSED(x);
-	return &cpu_iter_ops;
+	return cpu_vecops();
 #endif
 }
 
@@ -2,6 +2,14 @@
 #ifndef __ITER_VEC_H
 #define __ITER_VEC_H
 
+/*
+ * Fused operations:
+ *
+ * axpy_dot:	a = a + alpha x, returns <x, a>
+ * axpy_norm:	a = a + alpha x, returns |a|
+ * axpy_xpay:	a = a + alpha x, x = beta x + y
+ * dual_resid:	u = g - z, r = z - u
+ */
 struct vec_iter_s {
 
 	float* (*allocate)(long N);
@@ -19,14 +27,22 @@ struct vec_iter_s {
 	void (*smul)(long N, float alpha, float* a, const float* x);
 	void (*xpay)(long N, float alpha, float* a, const float* x);
 	void (*axpy)(long N, float* a, float alpha, const float* x);
+
+	// fused operations (one pass over all vectors)
+	double (*axpy_dot)(long N, float* a, float alpha, const float* x);
+	double (*axpy_norm)(long N, float* a, float alpha, const float* x);
+	void (*axpy_xpay)(long N, float* a, float alpha, float* x, float beta, const float* y);
+	void (*dual_resid)(long N, float* u, float* r, const float* g, const float* z);
 };
 
 #ifdef USE_CUDA
 extern const struct vec_iter_s gpu_iter_ops;
 #endif
 extern const struct vec_iter_s cpu_iter_ops;
+extern const struct vec_iter_s cpu_par_iter_ops;
 
 extern const struct vec_iter_s* select_vecops(const float* x);
+extern const struct vec_iter_s* scratch_vecops(const char* dir);
 
 
 #endif
@@ -16,6 +16,7 @@
 #include "num/ops.h"
 
 #include "misc/misc.h"
+#include "misc/trace.h"
 
 #include "linop.h"
 
@@ -286,7 +287,10 @@ void linop_normal(const struct linop_s* op, unsigned int N, const long dims[N],
 void linop_forward_unchecked(const struct linop_s* op, complex float* dst, const complex float* src)
 {
 	assert(op->forward);
+
+	TRACE_BEGIN();
 	operator_apply_unchecked(op->forward, dst, src);
+	TRACE_END(0., 0., "linop_forward");
 }
 
 
@@ -301,7 +305,10 @@ void linop_forward_unchecked(const struct linop_s* op, complex float* dst, const
 void linop_adjoint_unchecked(const struct linop_s* op, complex float* dst, const complex float* src)
 {
 	assert(op->adjoint);
+
+	TRACE_BEGIN();
 	operator_apply_unchecked(op->adjoint, dst, src);
+	TRACE_END(0., 0., "linop_adjoint");
 }
 
 
@@ -316,7 +323,10 @@ void linop_adjoint_unchecked(const struct linop_s* op, complex float* dst, const
 void linop_normal_unchecked(const struct linop_s* op, complex float* dst, const complex float* src)
 {
 	assert(op->normal);
+
+	TRACE_BEGIN();
 	operator_apply_unchecked(op->normal, dst, src);
+	TRACE_END(0., 0., "linop_normal");
 }
 
 
@@ -331,7 +341,9 @@ void linop_normal_unchecked(const struct linop_s* op, complex float* dst, const
  */
 void linop_norm_inv_unchecked(const struct linop_s* op, float lambda, complex float* dst, const complex float* src)
 {
+	TRACE_BEGIN();
 	operator_p_apply_unchecked(op->norm_inv, lambda, dst, src);
+	TRACE_END(0., 0., "linop_norm_inv");
 }
 
 
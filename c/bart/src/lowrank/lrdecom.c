@@ -0,0 +1,413 @@
+/* Copyright 2026. The Regents of the University of California.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ *
+ * Authors:
+ * 2026 agent <agent@local>
+ *
+ * ADMM for the multi-scale low rank decomposition
+ *
+ *	min sum_l lambda_l || X_l ||_*   s.t.   P sum_l X_l / sqrt(L) = y
+ *
+ * with the splitting X = Z, where Z carries the sum constraint.
+ * The Z update is a projection onto the constraint set in closed
+ * form. After it, the scaled dual U = X + U - Z is the same for all
+ * levels, so only one image of dual variables is stored, and X and
+ * Z share one buffer. Compared to the generic ADMM with two identity
+ * blocks this keeps one copy of the decomposition instead of seven.
+ *
+ * Levels skipped by the thresholding (see lrthresh_set_prune) have
+ * X = 0, so their Z equals the last correction D and is not stored:
+ * such levels drop out of all updates until they are re-checked.
+ *
+ * If the thresholding is distributed with partial output (see
+ * lrthresh_set_partition), each process only holds X on its own
+ * blocks. As the blocks are fixed, only the sum over the levels is
+ * all-reduced in each iteration. Blocks which wrap around the image
+ * also read X of other processes, which lrthresh exchanges on these
+ * elements only.
+ */
+
+#include <complex.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "misc/misc.h"
+#include "misc/mri.h"
+#include "misc/debug.h"
+#include "misc/trace.h"
+#include "misc/mmio.h"
+
+#include "num/multind.h"
+#include "num/flpmath.h"
+#include "num/ops.h"
+#include "num/mpi.h"
+
+#include "lowrank/lrthresh.h"
+
+#include "lrdecom.h"
+
+
+const struct lrdecom_conf lrdecom_defaults = {
+
+	.maxiter = 100,
+	.rho = 0.25,
+	.hogwild = false,
+	.check_every = 0,
+	.tol = 0.,
+	.scratch = NULL,
+};
+
+
+
+/*
+ * odata holds the initial Z on input (zero for a cold start)
+ * and the low rank components X on output.
+ */
+void lrdecom(const struct lrdecom_conf* conf, const long odims[DIMS], complex float* odata, const complex float* idata, const complex float* pattern, const struct operator_p_s* lr_prox)
+{
+	long idims[DIMS];
+	md_select_dims(DIMS, ~LEVEL_FLAG, idims, odims);
+
+	long ostrs[DIMS];
+	md_calc_strides(DIMS, ostrs, odims, CFL_SIZE);
+
+	long levels = odims[LEVEL_DIM];
+	long lstr = ostrs[LEVEL_DIM] / CFL_SIZE;
+	float scale = 1. / sqrtf(levels);
+
+	// levels with X = 0 which are stored as zero instead of Z = D
+	bool implicit[levels];
+	bool skip[MAX_LEV];
+
+	for (long l = 0; l < levels; l++)
+		implicit[l] = false;
+
+	bool partial = lrthresh_is_partial(lr_prox);
+
+	complex float* u;
+	complex float* tmp;
+
+	if (NULL != conf->scratch) {
+
+		u = scratch_cfl(conf->scratch, DIMS, idims);
+		tmp = scratch_cfl(conf->scratch, DIMS, idims);
+
+	} else {
+
+		u = md_alloc_sameplace(DIMS, idims, CFL_SIZE, odata);
+		tmp = md_alloc_sameplace(DIMS, idims, CFL_SIZE, odata);
+	}
+
+	md_clear(DIMS, idims, u, CFL_SIZE);
+
+	float rho = conf->rho;
+
+	int hw_K = 1;
+	int hw_k = 0;
+
+	float obj_last = 0.;
+
+	for (unsigned int i = 0; i < conf->maxiter; i++) {
+
+		// one trace event per iteration, closed here or after the loop
+		if (0 < i)
+			TRACE_END(0., 0., "lrdecom iter");
+
+		TRACE_BEGIN();
+
+		lrthresh_get_skipped(lr_prox, skip);
+
+		// X = SVT(Z - U)
+		for (long l = 0; l < levels; l++) {
+
+			if (skip[l])
+				continue;
+
+			if (implicit[l])
+				md_zsub(DIMS, idims, odata + l * lstr, tmp, u);
+			else
+				md_zsub(DIMS, idims, odata + l * lstr, odata + l * lstr, u);
+		}
+
+		operator_p_apply_unchecked(lr_prox, 1. / rho, odata, odata);
+
+		if (i + 1 == conf->maxiter)
+			break;
+
+		bool check = (conf->check_every > 0) && (0 == (i + 1) % conf->check_every);
+
+		// residual of the constraint for X + U
+		md_clear(DIMS, idims, tmp, CFL_SIZE);
+
+		for (long l = 0; l < levels; l++)
+			if (!skip[l])
+				md_zadd(DIMS, idims, tmp, tmp, odata + l * lstr);
+
+		if (partial)
+			mpi_allreduce_sum(2 * md_calc_size(DIMS, idims), (float*)tmp);
+
+		md_zsmul(DIMS, idims, tmp, tmp, -scale);
+		md_zadd(DIMS, idims, tmp, tmp, idata);
+		md_zaxpy(DIMS, idims, tmp, -sqrtf(levels), u);
+
+		if (NULL != pattern)
+			md_zmul(DIMS, idims, tmp, tmp, pattern);
+
+		// Z = X + U + C and U = -C, so Z = X + D and U = U - D with D = U + C
+		md_zsmul(DIMS, idims, tmp, tmp, scale);
+		md_zadd(DIMS, idims, tmp, tmp, u);
+
+		// test before the Z update, so that odata holds X on return
+		if (check) {
+
+			float xnorm = md_znorm(DIMS, odims, odata);
+
+			if (partial) {
+
+				xnorm *= xnorm;
+				mpi_allreduce_sum(1, &xnorm);
+				xnorm = sqrtf(xnorm);
+			}
+
+			// X - Z = -D on every level
+			float r_norm = sqrtf(levels) * md_znorm(DIMS, idims, tmp);
+			float r_rel = (xnorm > 0.) ? (r_norm / xnorm) : 0.;
+
+			float nucnorm[MAX_LEV];
+			int L = lrthresh_get_nucnorm(lr_prox, nucnorm);
+
+			float obj = 0.;
+
+			for (int l = 0; l < L; l++)
+				obj += nucnorm[l];
+
+			float dobj = (0. != obj_last) ? (fabsf(obj - obj_last) / fabsf(obj_last)) : 1.;
+
+			obj_last = obj;
+
+			debug_printf(DP_DEBUG3, "### ITER: %d r: %.4e obj: %.4e dobj: %.4e\n", i, r_norm, obj, dobj);
+
+			if ((conf->tol > 0.) && ((r_rel < conf->tol) || (dobj < conf->tol))) {
+
+				debug_printf(DP_DEBUG2, "Converged after %d iterations.\n", i + 1);
+				break;
+			}
+
+		} else {
+
+			debug_printf(DP_DEBUG3, "### ITER: %d\n", i);
+		}
+
+		for (long l = 0; l < levels; l++) {
+
+			implicit[l] = skip[l];
+
+			if (!skip[l])
+				md_zadd(DIMS, idims, odata + l * lstr, odata + l * lstr, tmp);
+		}
+
+		md_zsub(DIMS, idims, u, u, tmp);
+
+		if (conf->hogwild) {
+
+			if (++hw_k == hw_K) {
+
+				hw_k = 0;
+				hw_K *= 2;
+				rho *= 2.;
+				md_zsmul(DIMS, idims, u, u, 0.5);
+			}
+		}
+	}
+
+	if (0 < conf->maxiter)
+		TRACE_END(0., 0., "lrdecom iter");
+
+	// assemble X on the first process
+	if (partial)
+		mpi_reduce_sum(2 * md_calc_size(DIMS, odims), (float*)odata);
+
+	if (NULL != conf->scratch) {
+
+		unmap_cfl(DIMS, idims, u);
+		unmap_cfl(DIMS, idims, tmp);
+
+	} else {
+
+		md_free(u);
+		md_free(tmp);
+	}
+}
+
+
+
+/*
+ * Completion from a sparse list of observed entries (linear indices
+ * idx into one level of odims with values val). Off the observed
+ * entries the projection is zero, so after the first iteration the
+ * dual U and the correction D are supported on idx only and are
+ * kept as lists. Besides the decomposition itself this needs O(nnz)
+ * memory, no dense data or pattern. With a scratch directory the
+ * lists are kept in files as well.
+ */
+void lrdecom_sparse(const struct lrdecom_conf* conf, const long odims[DIMS], complex float* odata, long nnz, const long* idx, const complex float* val, const struct operator_p_s* lr_prox)
+{
+	long ostrs[DIMS];
+	md_calc_strides(DIMS, ostrs, odims, CFL_SIZE);
+
+	long levels = odims[LEVEL_DIM];
+	long lstr = ostrs[LEVEL_DIM] / CFL_SIZE;
+	float scale = 1. / sqrtf(levels);
+
+	bool implicit[levels];
+	bool skip[MAX_LEV];
+
+	for (long l = 0; l < levels; l++)
+		implicit[l] = false;
+
+	assert(!lrthresh_is_partial(lr_prox));
+
+	long ldims[DIMS];		// the lists of U and D
+	md_singleton_dims(DIMS, ldims);
+	ldims[0] = nnz;
+
+	complex float* u;
+	complex float* d;
+
+	if (NULL != conf->scratch) {
+
+		u = scratch_cfl(conf->scratch, DIMS, ldims);
+		d = scratch_cfl(conf->scratch, DIMS, ldims);
+
+	} else {
+
+		u = xmalloc(nnz * sizeof(complex float));
+		d = xmalloc(nnz * sizeof(complex float));
+	}
+
+	for (long k = 0; k < nnz; k++)
+		u[k] = 0.;
+
+	float rho = conf->rho;
+
+	int hw_K = 1;
+	int hw_k = 0;
+
+	float obj_last = 0.;
+
+	for (unsigned int i = 0; i < conf->maxiter; i++) {
+
+		lrthresh_get_skipped(lr_prox, skip);
+
+		// X = SVT(Z - U)
+		for (long l = 0; l < levels; l++) {
+
+			if (skip[l])
+				continue;
+
+			if (implicit[l])
+				for (long k = 0; k < nnz; k++)
+					odata[l * lstr + idx[k]] = d[k] - u[k];
+			else
+				for (long k = 0; k < nnz; k++)
+					odata[l * lstr + idx[k]] -= u[k];
+		}
+
+		operator_p_apply_unchecked(lr_prox, 1. / rho, odata, odata);
+
+		if (i + 1 == conf->maxiter)
+			break;
+
+		bool check = (conf->check_every > 0) && (0 == (i + 1) % conf->check_every);
+
+		// D = U + C with C the projected residual of the constraint for X + U
+		double dnorm = 0.;
+
+		for (long k = 0; k < nnz; k++) {
+
+			complex float sum = 0.;
+
+			for (long l = 0; l < levels; l++)
+				if (!skip[l])
+					sum += odata[l * lstr + idx[k]];
+
+			complex float c = val[k] - scale * sum - sqrtf(levels) * u[k];
+
+			d[k] = scale * c + u[k];
+			dnorm += crealf(d[k] * conjf(d[k]));
+		}
+
+		// test before the Z update, so that odata holds X on return
+		if (check) {
+
+			float xnorm = md_znorm(DIMS, odims, odata);
+			float r_norm = sqrtf(levels * dnorm);
+			float r_rel = (xnorm > 0.) ? (r_norm / xnorm) : 0.;
+
+			float nucnorm[MAX_LEV];
+			int L = lrthresh_get_nucnorm(lr_prox, nucnorm);
+
+			float obj = 0.;
+
+			for (int l = 0; l < L; l++)
+				obj += nucnorm[l];
+
+			float dobj = (0. != obj_last) ? (fabsf(obj - obj_last) / fabsf(obj_last)) : 1.;
+
+			obj_last = obj;
+
+			debug_printf(DP_DEBUG3, "### ITER: %d r: %.4e obj: %.4e dobj: %.4e\n", i, r_norm, obj, dobj);
+
+			if ((conf->tol > 0.) && ((r_rel < conf->tol) || (dobj < conf->tol))) {
+
+				debug_printf(DP_DEBUG2, "Converged after %d iterations.\n", i + 1);
+				break;
+			}
+
+		} else {
+
+			debug_printf(DP_DEBUG3, "### ITER: %d\n", i);
+		}
+
+		// Z = X + D, U = U - D
+		for (long l = 0; l < levels; l++) {
+
+			implicit[l] = skip[l];
+
+			if (!skip[l])
+				for (long k = 0; k < nnz; k++)
+					odata[l * lstr + idx[k]] += d[k];
+		}
+
+		for (long k = 0; k < nnz; k++)
+			u[k] -= d[k];
+
+		if (conf->hogwild) {
+
+			if (++hw_k == hw_K) {
+
+				hw_k = 0;
+				hw_K *= 2;
+				rho *= 2.;
+
+				for (long k = 0; k < nnz; k++)
+					u[k] *= 0.5;
+			}
+		}
+	}
+
+	if (NULL != conf->scratch) {
+
+		unmap_cfl(DIMS, ldims, u);
+		unmap_cfl(DIMS, ldims, d);
+
+	} else {
+
+		free(u);
+		free(d);
+	}
+}
+
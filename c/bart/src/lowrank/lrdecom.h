@@ -0,0 +1,30 @@
+/* Copyright 2026. The Regents of the University of California.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ */
+
+#include <complex.h>
+#include <stdbool.h>
+
+#include "misc/mri.h"
+
+struct operator_p_s;
+
+struct lrdecom_conf {
+
+	unsigned int maxiter;
+	float rho;
+	bool hogwild;
+	unsigned int check_every;
+	double tol;
+	const char* scratch;	// keep the dual and temporary in files in this directory
+};
+
+extern const struct lrdecom_conf lrdecom_defaults;
+
+// Multi-scale low rank decomposition with the sum constraint folded into ADMM
+extern void lrdecom(const struct lrdecom_conf* conf, const long odims[DIMS], complex float* odata, const complex float* idata, const complex float* pattern, const struct operator_p_s* lr_prox);
+
+// Completion from observed entries given as linear indices into one level
+extern void lrdecom_sparse(const struct lrdecom_conf* conf, const long odims[DIMS], complex float* odata, long nnz, const long* idx, const complex float* val, const struct operator_p_s* lr_prox);
+
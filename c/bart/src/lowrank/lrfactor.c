@@ -0,0 +1,507 @@
+/* Copyright 2026. The Regents of the University of California.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ *
+ * Authors:
+ * 2026 agent <agent@local>
+ *
+ * Factored storage of multi-scale low rank decompositions.
+ *
+ * Each block of each level is stored as its truncated SVD, using the
+ * block geometry (including the circular shift) of lrthresh. The file
+ * consists of a header, the rank of every block, and the factors:
+ *
+ *	char magic[8]			"BARTLRF1"
+ *	int64 D, dims[D], levels
+ *	per level: int64 M, N, B, blkdims[D], zpad_dims[D], grid_dims[D], shift[D]
+ *	per level: int32 rank[B]
+ *	per block of rank r > 0: U (M x r), S (r, float), VH (r x N)
+ *
+ * Matrices are complex float in column-major order, all in host byte
+ * order. Levels, sums of levels or crops can be reconstructed without
+ * reading the factors of other blocks.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <complex.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "misc/misc.h"
+#include "misc/mri.h"
+#include "misc/debug.h"
+
+#include "num/multind.h"
+#include "num/flpmath.h"
+#include "num/lapack.h"
+#include "num/casorati.h"
+
+#include "lowrank/lrthresh.h"
+
+#include "lrfactor.h"
+
+
+static const char lrf_magic[8] = "BARTLRF1";
+
+
+struct lrfactor_s {
+
+	FILE* fp;
+
+	long dims[DIMS];
+	int levels;
+
+	struct lrthresh_geom_s geom[MAX_LEV];
+
+	int32_t* rank[MAX_LEV];
+	long* offset[MAX_LEV];		// file position of the factors of each block
+};
+
+
+
+static void write_longs(FILE* fp, long N, const long x[N])
+{
+	for (long i = 0; i < N; i++) {
+
+		int64_t v = x[i];
+
+		if (1 != fwrite(&v, sizeof(v), 1, fp))
+			error("Writing factors");
+	}
+}
+
+
+static void read_longs(FILE* fp, long N, long x[N])
+{
+	for (long i = 0; i < N; i++) {
+
+		int64_t v;
+
+		if (1 != fread(&v, sizeof(v), 1, fp))
+			error("Reading factors");
+
+		x[i] = v;
+	}
+}
+
+
+static void write_geom(FILE* fp, const struct lrthresh_geom_s* g)
+{
+	write_longs(fp, 3, (long[3]){ g->M, g->N, g->B });
+	write_longs(fp, DIMS, g->blkdims);
+	write_longs(fp, DIMS, g->zpad_dims);
+	write_longs(fp, DIMS, g->grid_dims);
+	write_longs(fp, DIMS, g->shift);
+}
+
+
+static void read_geom(FILE* fp, struct lrthresh_geom_s* g)
+{
+	long mnb[3];
+	read_longs(fp, 3, mnb);
+
+	g->M = mnb[0];
+	g->N = mnb[1];
+	g->B = mnb[2];
+
+	read_longs(fp, DIMS, g->blkdims);
+	read_longs(fp, DIMS, g->zpad_dims);
+	read_longs(fp, DIMS, g->grid_dims);
+	read_longs(fp, DIMS, g->shift);
+
+	g->rank = NULL;
+}
+
+
+static void block_pos(long pos[DIMS], long b, const long grid_dims[DIMS])
+{
+	for (unsigned int i = 0; i < DIMS; i++) {
+
+		pos[i] = b % grid_dims[i];
+		b /= grid_dims[i];
+	}
+}
+
+
+static long* circ_index_create(const struct lrthresh_geom_s* g, long* gidx[DIMS], long* sidx[DIMS], const long dims[DIMS], const long strs[DIMS])
+{
+	long size = 0;
+
+	for (unsigned int i = 0; i < DIMS; i++)
+		size += 2 * g->zpad_dims[i];
+
+	long* idx = xmalloc(size * sizeof(long));
+	long* ptr = idx;
+
+	for (unsigned int i = 0; i < DIMS; i++) {
+
+		gidx[i] = ptr;
+		sidx[i] = ptr + g->zpad_dims[i];
+		ptr += 2 * g->zpad_dims[i];
+	}
+
+	basorati_circ_index(DIMS, gidx, sidx, g->zpad_dims, g->shift, dims, strs);
+
+	return idx;
+}
+
+
+
+/*
+ * Clear the entries of a block which are copies from the circular
+ * extension, i.e. owned by other blocks. The owned entries form a
+ * submatrix of the Casorati matrix, so this does not increase the
+ * rank of the block thresholded by lrthresh.
+ */
+static void block_clear_copies(const long blkdims[DIMS], const long pos[DIMS], long* sidx[DIMS], complex float* blk)
+{
+	long size = md_calc_size(DIMS, blkdims);
+
+	for (long e = 0; e < size; e++) {
+
+		long r = e;
+		bool owned = true;
+
+		for (unsigned int i = 0; i < DIMS; i++) {
+
+			owned = owned && (0 <= sidx[i][pos[i] * blkdims[i] + r % blkdims[i]]);
+			r /= blkdims[i];
+		}
+
+		if (!owned)
+			blk[e] = 0.;
+	}
+}
+
+
+
+/**
+ * Write the decomposition src (odims, levels along LEVEL_DIM) with the
+ * block geometry geom of each level. If src is the output of lrthresh,
+ * its blocks have the ranks in geom and are stored exactly. Otherwise
+ * singular values below tol times the largest one of a block are dropped.
+ */
+void lrfactor_write(const char* name, const long odims[DIMS], const struct lrthresh_geom_s* geom, float tol, const complex float* src)
+{
+	FILE* fp = fopen(name, "w");
+
+	if (NULL == fp)
+		error("Creating factor file %s\n", name);
+
+	long levels = odims[LEVEL_DIM];
+
+	long dims[DIMS];
+	md_select_dims(DIMS, ~LEVEL_FLAG, dims, odims);
+
+	long ostrs[DIMS];
+	md_calc_strides(DIMS, ostrs, odims, CFL_SIZE);
+
+	if (1 != fwrite(lrf_magic, sizeof(lrf_magic), 1, fp))
+		error("Writing factors");
+
+	write_longs(fp, 1, (long[1]){ DIMS });
+	write_longs(fp, DIMS, dims);
+	write_longs(fp, 1, &levels);
+
+	long nblocks = 0;
+
+	for (int l = 0; l < levels; l++) {
+
+		write_geom(fp, &geom[l]);
+		nblocks += geom[l].B;
+	}
+
+	// ranks are filled in at the end
+	long rank_pos = ftell(fp);
+
+	int32_t* rank = xmalloc(nblocks * sizeof(int32_t));
+
+	for (long b = 0; b < nblocks; b++)
+		rank[b] = 0;
+
+	if (nblocks != (long)fwrite(rank, sizeof(int32_t), nblocks, fp))
+		error("Writing factors");
+
+	long bytes = 0;
+	long dense = 0;
+	int32_t* r = rank;
+
+	for (int l = 0; l < levels; l++) {
+
+		const struct lrthresh_geom_s* g = &geom[l];
+
+		long M = g->M;
+		long N = g->N;
+		long K = MIN(M, N);
+
+		long* gidx[DIMS];
+		long* sidx[DIMS];
+		long* idx = circ_index_create(g, gidx, sidx, dims, ostrs);
+
+		complex float* blk = xmalloc(M * N * sizeof(complex float));
+		complex float* U = xmalloc(M * K * sizeof(complex float));
+		complex float* VH = xmalloc(K * N * sizeof(complex float));
+		float* S = xmalloc(K * sizeof(float));
+
+		const complex float* srcl = src + l * ostrs[LEVEL_DIM] / CFL_SIZE;
+
+		for (long b = 0; b < g->B; b++) {
+
+			long pos[DIMS];
+			block_pos(pos, b, g->grid_dims);
+
+			if (0. == basorati_gather_block(DIMS, g->blkdims, pos, (const long**)gidx, blk, srcl))
+				continue;
+
+			block_clear_copies(g->blkdims, pos, sidx, blk);
+
+			lapack_svd_econ(M, N, (complex float (*)[])U, (complex float (*)[])VH, S, (complex float (*)[])blk);
+
+			long k = 0;
+
+			while ((k < K) && (S[k] > tol * S[0]))
+				k++;
+
+			if ((NULL != g->rank) && (0 <= g->rank[b]))
+				k = MIN(k, g->rank[b]);
+
+			// rows of VH are strided
+			for (long j = 0; j < N; j++)
+				for (long i = 0; i < k; i++)
+					blk[i + j * k] = VH[i + j * K];
+
+			if (   (M * k != (long)fwrite(U, sizeof(complex float), M * k, fp))
+			    || (k != (long)fwrite(S, sizeof(float), k, fp))
+			    || (k * N != (long)fwrite(blk, sizeof(complex float), k * N, fp)))
+				error("Writing factors");
+
+			bytes += (M * k + k * N) * sizeof(complex float) + k * sizeof(float);
+			r[b] = k;
+		}
+
+		dense += md_calc_size(DIMS, dims) * CFL_SIZE;
+		r += g->B;
+
+		free(blk);
+		free(U);
+		free(VH);
+		free(S);
+		free(idx);
+	}
+
+	fseek(fp, rank_pos, SEEK_SET);
+
+	if (nblocks != (long)fwrite(rank, sizeof(int32_t), nblocks, fp))
+		error("Writing factors");
+
+	free(rank);
+
+	if (0 != fclose(fp))
+		error("Writing factors");
+
+	debug_printf(DP_DEBUG1, "Factors: %.1f MB (dense: %.1f MB)\n", bytes / 1.E6, dense / 1.E6);
+}
+
+
+
+struct lrfactor_s* lrfactor_open(const char* name)
+{
+	struct lrfactor_s* f = xmalloc(sizeof(struct lrfactor_s));
+
+	f->fp = fopen(name, "r");
+
+	if (NULL == f->fp)
+		error("Opening factor file %s\n", name);
+
+	char magic[8];
+	long D;
+
+	if (   (1 != fread(magic, sizeof(magic), 1, f->fp))
+	    || (0 != memcmp(magic, lrf_magic, sizeof(magic))))
+		error("Not a factor file: %s\n", name);
+
+	read_longs(f->fp, 1, &D);
+
+	if (DIMS != D)
+		error("Not a factor file: %s\n", name);
+
+	read_longs(f->fp, DIMS, f->dims);
+
+	long levels;
+	read_longs(f->fp, 1, &levels);
+
+	assert(levels <= MAX_LEV);
+	f->levels = levels;
+
+	for (int l = 0; l < f->levels; l++)
+		read_geom(f->fp, &f->geom[l]);
+
+	for (int l = 0; l < f->levels; l++) {
+
+		long B = f->geom[l].B;
+
+		f->rank[l] = xmalloc(B * sizeof(int32_t));
+
+		if (B != (long)fread(f->rank[l], sizeof(int32_t), B, f->fp))
+			error("Reading factors");
+	}
+
+	long offset = ftell(f->fp);
+
+	for (int l = 0; l < f->levels; l++) {
+
+		const struct lrthresh_geom_s* g = &f->geom[l];
+
+		f->offset[l] = xmalloc(g->B * sizeof(long));
+
+		for (long b = 0; b < g->B; b++) {
+
+			long k = f->rank[l][b];
+
+			f->offset[l][b] = offset;
+			offset += (g->M * k + k * g->N) * sizeof(complex float) + k * sizeof(float);
+		}
+	}
+
+	return f;
+}
+
+
+void lrfactor_close(struct lrfactor_s* f)
+{
+	for (int l = 0; l < f->levels; l++) {
+
+		free(f->rank[l]);
+		free(f->offset[l]);
+	}
+
+	fclose(f->fp);
+	free(f);
+}
+
+
+int lrfactor_levels(const struct lrfactor_s* f)
+{
+	return f->levels;
+}
+
+
+void lrfactor_dims(const struct lrfactor_s* f, long dims[DIMS])
+{
+	md_copy_dims(DIMS, dims, f->dims);
+}
+
+
+/**
+ * Largest rank of the blocks of a level
+ */
+long lrfactor_rank(const struct lrfactor_s* f, int level)
+{
+	long rank = 0;
+
+	for (long b = 0; b < f->geom[level].B; b++)
+		rank = MAX(rank, f->rank[level][b]);
+
+	return rank;
+}
+
+
+/**
+ * Reconstruct level into dst, a crop of size odims at position pos
+ * of the image. Only blocks which intersect the crop are read.
+ */
+void lrfactor_level(struct lrfactor_s* f, int level, const long pos[DIMS], const long odims[DIMS], complex float* dst)
+{
+	const struct lrthresh_geom_s* g = &f->geom[level];
+
+	long M = g->M;
+	long N = g->N;
+
+	long ostrs[DIMS];
+	md_calc_strides(DIMS, ostrs, odims, CFL_SIZE);
+
+	// image coordinates of the elements of the extended image ...
+	long cstrs[DIMS];
+
+	for (unsigned int i = 0; i < DIMS; i++)
+		cstrs[i] = CFL_SIZE;
+
+	long* gidx[DIMS];
+	long* sidx[DIMS];
+	long* idx = circ_index_create(g, gidx, sidx, f->dims, cstrs);
+
+	// ... turned into offsets in the crop, or -1 outside
+	bool* hit[DIMS];
+
+	for (unsigned int i = 0; i < DIMS; i++) {
+
+		hit[i] = xmalloc(g->grid_dims[i] * sizeof(bool));
+
+		for (long k = 0; k < g->grid_dims[i]; k++)
+			hit[i][k] = false;
+
+		for (long z = 0; z < g->zpad_dims[i]; z++) {
+
+			long c = sidx[i][z] - pos[i];
+
+			sidx[i][z] = ((sidx[i][z] >= 0) && (c >= 0) && (c < odims[i])) ? (c * ostrs[i] / (long)CFL_SIZE) : -1;
+
+			if (sidx[i][z] >= 0)
+				hit[i][z / g->blkdims[i]] = true;
+		}
+	}
+
+	md_clear(DIMS, odims, dst, CFL_SIZE);
+
+	long K = MIN(M, N);
+
+	complex float* blk = xmalloc(M * N * sizeof(complex float));
+	complex float* U = xmalloc(M * K * sizeof(complex float));
+	complex float* VH = xmalloc(K * N * sizeof(complex float));
+	float* S = xmalloc(K * sizeof(float));
+
+	for (long b = 0; b < g->B; b++) {
+
+		long k = f->rank[level][b];
+
+		long bpos[DIMS];
+		block_pos(bpos, b, g->grid_dims);
+
+		bool inside = true;
+
+		for (unsigned int i = 0; i < DIMS; i++)
+			inside = inside && hit[i][bpos[i]];
+
+		if ((0 == k) || !inside)
+			continue;
+
+		fseek(f->fp, f->offset[level][b], SEEK_SET);
+
+		if (   (M * k != (long)fread(U, sizeof(complex float), M * k, f->fp))
+		    || (k != (long)fread(S, sizeof(float), k, f->fp))
+		    || (k * N != (long)fread(VH, sizeof(complex float), k * N, f->fp)))
+			error("Reading factors");
+
+		for (long j = 0; j < N; j++)
+			for (long i = 0; i < k; i++)
+				VH[i + j * k] *= S[i];
+
+		lapack_matrix_multiply(M, N, k, (complex float (*)[])blk, (const complex float (*)[])U, (const complex float (*)[])VH);
+
+		basorati_scatter_block(DIMS, g->blkdims, bpos, (const long**)sidx, dst, blk);
+	}
+
+	free(blk);
+	free(U);
+	free(VH);
+	free(S);
+
+	for (unsigned int i = 0; i < DIMS; i++)
+		free(hit[i]);
+
+	free(idx);
+}
+
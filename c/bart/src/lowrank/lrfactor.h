@@ -0,0 +1,25 @@
+/* Copyright 2026. The Regents of the University of California.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ */
+
+#include <complex.h>
+
+#include "misc/mri.h"
+
+struct lrthresh_geom_s;
+struct lrfactor_s;
+
+// Write the levels of a decomposition as truncated per-block factors
+extern void lrfactor_write(const char* name, const long odims[DIMS], const struct lrthresh_geom_s* geom, float tol, const complex float* src);
+
+// Read factors back
+extern struct lrfactor_s* lrfactor_open(const char* name);
+extern void lrfactor_close(struct lrfactor_s* f);
+extern int lrfactor_levels(const struct lrfactor_s* f);
+extern void lrfactor_dims(const struct lrfactor_s* f, long dims[DIMS]);
+extern long lrfactor_rank(const struct lrfactor_s* f, int level);
+
+// Reconstruct level l into dst (image of dims[], or a crop at pos of size odims[])
+extern void lrfactor_level(struct lrfactor_s* f, int level, const long pos[DIMS], const long odims[DIMS], complex float* dst);
+
@@ -11,15 +11,22 @@
  * 2014 Martin Uecker 
  */
 
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <complex.h>
 #include <math.h>
 #include <stdbool.h>
 #include <assert.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "misc/misc.h"
 #include "misc/mri.h"
 #include "misc/debug.h"
+#include "misc/trace.h"
+#include "misc/mmio.h"
 
 #include "num/multind.h"
 #include "num/flpmath.h"
@@ -29,6 +36,7 @@
 #include "num/iovec.h"
 #include "num/blockproc.h"
 #include "num/casorati.h"
+#include "num/mpi.h"
 
 #include "iter/thresh.h"
 
@@ -37,6 +45,10 @@
 #include "lrthresh.h"
 
 
+// smallest block dimension for which randomized SVT is used
+#define SVT_RAND_MINSIZE 32
+
+
 struct lrthresh_data_s {
 
 	float lambda;
@@ -55,12 +67,84 @@ struct lrthresh_data_s {
 	unsigned long flags;
 	long levels;
 	long blkdims[MAX_LEV][DIMS];
+
+	// block geometry of each level
+	long zpad_dims[MAX_LEV][DIMS];
+	long M[MAX_LEV];
+	long N[MAX_LEV];
+	long B[MAX_LEV];
+
+	long grid_dims[MAX_LEV][DIMS];	// number of blocks
+	long shift[MAX_LEV][DIMS];	// block shifts of the last call
+
+	// index tables of the shifted and extended image (see basorati_circ_index)
+	long* idx[MAX_LEV];
+	long* gidx[MAX_LEV][DIMS];
+	long* sidx[MAX_LEV][DIMS];
+
+	// workspace, allocated once and reused in every apply
+	bool wrap;			// blocks wrap around the image
+	complex float* tmp_src;		// copy of the input for in-place calls (allocated on first use)
+	complex float* tmp_blk;		// nthreads x max block size
+	long max_blk;
+
+	// blocks which were not thresholded to zero in the last call
+	bool* active[MAX_LEV];
+
+	// nuclear norm of each block and level after the last call
+	float* nucnorm[MAX_LEV];
+	float level_nucnorm[MAX_LEV];
+
+	int nthreads;
+	struct svthresh_work_s** ws;	// nthreads x levels (allocated on first use)
+	enum svthresh_method method[MAX_LEV];
+
+	// exact SVT in real arithmetic (imaginary parts are discarded)
+	bool real;
+
+	// SVT backend of each level
+	enum svthresh_backend backend[MAX_LEV];
+	struct svthresh_rand_s** rws;	// nthreads x levels
+	long* rank[MAX_LEV];		// surviving rank of each block
+
+	// cached right singular subspaces for warm starts
+	complex float* vcache[MAX_LEV];
+	long* ncached[MAX_LEV];
+
+	// level pruning (see lrthresh_set_prune)
+	int prune_after;
+	int recheck;
+	long ncalls;
+	long zero_calls[MAX_LEV];	// consecutive calls with a zero output
+	bool frozen[MAX_LEV];
+	long frozen_at[MAX_LEV];	// call in which the level was frozen
+	bool was_active[MAX_LEV];	// level had a nonzero output
+	long first_active;		// first call with a nonzero output (0: none yet)
+	long skipped[MAX_LEV];		// calls in which the level was skipped
+
+	// distributed mode (see lrthresh_set_partition)
+	int proc;
+	int nprocs;
+	bool partial;
+	complex float* halo[MAX_LEV];	// output of other processes read by wrapping blocks
+	bool last_skip[MAX_LEV];	// levels skipped in the last call (block ownership)
+	bool ranks_gathered;		// the first process has the ranks of all blocks
+
+	// cycle spinning (see lrthresh_set_cyclespin)
+	int nshifts;
+	bool seeded;
+	unsigned int seed;		// state of the shift generator
+	complex float* tmp_spin;	// output of one shift (allocated on first use)
+
+	// directory for copies of all levels (see lrthresh_set_scratch)
+	const char* scratch;
 };
 
 
 
 static struct lrthresh_data_s* lrthresh_create_data(const long dims_decom[DIMS], bool randshift, unsigned long mflags, const long blkdims[MAX_LEV][DIMS], float lambda, bool noise, int remove_mean, bool use_gpu);
 static void lrthresh_free_data(const void* data);
+static void lrthresh_workspace_create(struct lrthresh_data_s* data);
 static void lrthresh_apply(const void* _data, float lambda, complex float* dst, const complex float* src);
 
 
@@ -121,32 +205,617 @@ static struct lrthresh_data_s* lrthresh_create_data(const long dims_decom[DIMS],
 	}
 
 	data->use_gpu = use_gpu;
+	data->real = false;
+
+	lrthresh_workspace_create(data);
 	
 	return data;
 }
 
 
 
+/**
+ * Compute block geometry of all levels and allocate
+ * the workspace used by lrthresh_apply
+ */
+static void lrthresh_workspace_create(struct lrthresh_data_s* data)
+{
+	long bytes = 0;
+
+	data->wrap = false;
+
+	data->max_blk = 0;
+
+	for (int l = 0; l < data->levels; l++) {
+
+		const long* blkdims = data->blkdims[l];
+
+		data->M[l] = 1;
+
+		for (unsigned int i = 0; i < DIMS; i++) {
+
+			data->zpad_dims[l][i] = (data->dims[i] + blkdims[i] - 1) / blkdims[i];
+			data->zpad_dims[l][i] *= blkdims[i];
+
+			if (MD_IS_SET(data->mflags, i))
+				data->M[l] *= blkdims[i];
+		}
+
+		long blk_size = md_calc_size(DIMS, blkdims);
+		long img_size = md_calc_size(DIMS, data->zpad_dims[l]);
+
+		data->N[l] = blk_size / data->M[l];
+		data->B[l] = img_size / blk_size;
+
+		if (data->noise && (l == data->levels - 1)) {
+
+			data->M[l] = img_size;
+			data->N[l] = 1;
+			data->B[l] = 1;
+		}
+
+		long idx_size = 0;
+
+		for (unsigned int i = 0; i < DIMS; i++) {
+
+			data->grid_dims[l][i] = data->zpad_dims[l][i] / blkdims[i];
+			idx_size += 2 * data->zpad_dims[l][i];
+			data->wrap = data->wrap || (data->zpad_dims[l][i] != data->dims[i]);
+		}
+
+		data->idx[l] = xmalloc(idx_size * sizeof(long));
+		bytes += idx_size * sizeof(long);
+
+		long* ptr = data->idx[l];
+
+		for (unsigned int i = 0; i < DIMS; i++) {
+
+			data->gidx[l][i] = ptr;
+			data->sidx[l][i] = ptr + data->zpad_dims[l][i];
+			ptr += 2 * data->zpad_dims[l][i];
+		}
+
+		data->max_blk = MAX(data->max_blk, blk_size);
+	}
+
+	data->tmp_src = NULL;
+
+#ifdef _OPENMP
+	data->nthreads = omp_get_max_threads();
+#else
+	data->nthreads = 1;
+#endif
+
+	// one block buffer per thread
+	long blk_dims[1] = { data->nthreads * data->max_blk };
+
+#ifdef USE_CUDA
+	data->tmp_blk = (data->use_gpu ? md_alloc_gpu : md_alloc)(1, blk_dims, CFL_SIZE);
+#else
+	data->tmp_blk = md_alloc(1, blk_dims, CFL_SIZE);
+#endif
+	bytes += blk_dims[0] * CFL_SIZE;
+
+	// one LAPACK workspace per thread and level, created when
+	// the thread first thresholds a block of this level
+	data->ws = xmalloc(data->nthreads * data->levels * sizeof(struct svthresh_work_s*));
+
+	for (int i = 0; i < data->nthreads * data->levels; i++)
+		data->ws[i] = NULL;
+
+	// exact SVT until a backend is selected
+	data->rws = NULL;
+
+	for (int l = 0; l < data->levels; l++) {
+
+		data->backend[l] = SVT_EXACT;
+		data->method[l] = SVT_METHOD_AUTO;
+		data->rank[l] = xmalloc(data->B[l] * sizeof(long));
+		data->active[l] = xmalloc(data->B[l] * sizeof(bool));
+		data->nucnorm[l] = xmalloc(data->B[l] * sizeof(float));
+		data->level_nucnorm[l] = 0.;
+		data->vcache[l] = NULL;
+		data->ncached[l] = NULL;
+		data->zero_calls[l] = 0;
+		data->frozen[l] = false;
+		data->frozen_at[l] = 0;
+		data->was_active[l] = false;
+		data->skipped[l] = 0;
+
+		for (long b = 0; b < data->B[l]; b++) {
+
+			data->rank[l][b] = -1;
+			data->active[l][b] = true;
+			data->nucnorm[l][b] = 0.;
+		}
+	}
+
+	data->prune_after = 0;
+	data->recheck = 0;
+	data->first_active = 0;
+	data->ncalls = 0;
+
+	data->proc = 0;
+	data->nprocs = 1;
+	data->partial = false;
+
+	for (int l = 0; l < MAX_LEV; l++) {
+
+		data->halo[l] = NULL;
+		data->last_skip[l] = false;
+	}
+
+	data->ranks_gathered = false;
+
+	data->nshifts = 1;
+	data->seeded = false;
+	data->seed = 0;
+	data->tmp_spin = NULL;
+
+	data->scratch = NULL;
+
+	debug_printf(DP_DEBUG1, "lrthresh workspace: %.1f MB (%d threads), peak RSS: %.1f MB\n",
+			(double)bytes / 1.E6, data->nthreads, (double)peak_memory() / 1.E6);
+}
+
+
+
+/**
+ * Allocate and free copies of all levels, in scratch files
+ * if a directory was set.
+ */
+static complex float* lrthresh_alloc_levels(const struct lrthresh_data_s* data)
+{
+	if (NULL != data->scratch)
+		return scratch_cfl(data->scratch, DIMS, data->dims_decom);
+#ifdef USE_CUDA
+	return (data->use_gpu ? md_alloc_gpu : md_alloc)(DIMS, data->dims_decom, CFL_SIZE);
+#else
+	return md_alloc(DIMS, data->dims_decom, CFL_SIZE);
+#endif
+}
+
+static void lrthresh_free_levels(const struct lrthresh_data_s* data, complex float* x)
+{
+	if (NULL != data->scratch)
+		unmap_cfl(DIMS, data->dims_decom, x);
+	else
+		md_free(x);
+}
+
+
+
 /**
  * Free lrthresh operator
  */
 static void lrthresh_free_data(const void* _data)
 {
-	free((void*)_data);
+	struct lrthresh_data_s* data = (struct lrthresh_data_s*)_data;
+
+	debug_printf(DP_DEBUG1, "lrthresh peak RSS: %.1f MB\n", (double)peak_memory() / 1.E6);
+
+	for (int l = 0; l < data->levels; l++)
+		free(data->idx[l]);
+
+	if (NULL != data->tmp_src)
+		lrthresh_free_levels(data, data->tmp_src);
+
+	if (NULL != data->tmp_spin)
+		lrthresh_free_levels(data, data->tmp_spin);
+
+	for (int l = 0; l < data->levels; l++)
+		md_free(data->halo[l]);
+
+	md_free(data->tmp_blk);
+
+	long bytes = 0;
+
+	for (int i = 0; i < data->nthreads * data->levels; i++) {
+
+		if (NULL != data->ws[i]) {
+
+			bytes += svthresh_work_size(data->ws[i]);
+			svthresh_work_free(data->ws[i]);
+		}
+	}
+
+	debug_printf(DP_DEBUG1, "lrthresh SVT workspaces: %.1f MB\n", (double)bytes / 1.E6);
+
+	free(data->ws);
+
+	if (NULL != data->rws) {
+
+		for (int i = 0; i < data->nthreads * data->levels; i++)
+			if (NULL != data->rws[i])
+				svthresh_rand_free(data->rws[i]);
+
+		free(data->rws);
+	}
+
+	for (int l = 0; l < data->levels; l++) {
+
+		free(data->rank[l]);
+		free(data->active[l]);
+		free(data->nucnorm[l]);
+
+		if (NULL != data->vcache[l]) {
+
+			free(data->vcache[l]);
+			free(data->ncached[l]);
+		}
+	}
+
+	free(data);
+}
+
+
+
+/**
+ * Select the singular value thresholding backend.
+ *
+ * SVT_RANDOMIZED and SVT_WARMSTART are only used for levels whose
+ * blocks are large enough (min(M, N) >= SVT_RAND_MINSIZE). Their target
+ * rank follows the surviving rank of the previous call, starting from
+ * an exact SVT. SVT_WARMSTART additionally caches the right singular
+ * subspace of each block and refines it by subspace iteration in the
+ * next call. Blocks fall back to the exact SVT whenever the rank
+ * estimate saturates or the iteration does not converge.
+ */
+void lrthresh_set_backend(const struct operator_p_s* op, enum svthresh_backend backend)
+{
+	struct lrthresh_data_s* data = (struct lrthresh_data_s*)operator_p_get_data(op);
+
+	bool approx = (SVT_RANDOMIZED == backend) || (SVT_WARMSTART == backend);
+
+	if (approx && (NULL == data->rws)) {
+
+		data->rws = xmalloc(data->nthreads * data->levels * sizeof(struct svthresh_rand_s*));
+
+		for (int i = 0; i < data->nthreads * data->levels; i++)
+			data->rws[i] = NULL;
+	}
+
+	for (int l = 0; l < data->levels; l++) {
+
+		long minMN = MIN(data->M[l], data->N[l]);
+
+		data->backend[l] = SVT_EXACT;
+
+		if (approx && (minMN >= SVT_RAND_MINSIZE)) {
+
+			data->backend[l] = backend;
+
+			for (int t = 0; t < data->nthreads; t++)
+				if (NULL == data->rws[t * data->levels + l])
+					data->rws[t * data->levels + l] = svthresh_rand_create(data->M[l], data->N[l], minMN / 4);
+
+			if ((SVT_WARMSTART == backend) && (NULL == data->vcache[l])) {
+
+				long csize = svthresh_warm_cachesize(data->rws[l]);
+
+				data->vcache[l] = xmalloc(data->B[l] * csize * sizeof(complex float));
+				data->ncached[l] = xmalloc(data->B[l] * sizeof(long));
+
+				for (long b = 0; b < data->B[l]; b++)
+					data->ncached[l][b] = 0;
+			}
+
+			debug_printf(DP_DEBUG1, "Level %d: %s SVT\n", l, (SVT_WARMSTART == backend) ? "warm-started" : "randomized");
+		}
+	}
+}
+
+
+
+/**
+ * Use real arithmetic (sgesvd_) for the exact SVT. For real-valued
+ * data this gives the same result as the complex SVT at a fraction
+ * of the cost; for complex data the imaginary part is discarded.
+ */
+void lrthresh_set_real(const struct operator_p_s* op, bool real)
+{
+	struct lrthresh_data_s* data = (struct lrthresh_data_s*)operator_p_get_data(op);
+
+	data->real = real;
+}
+
+
+
+/**
+ * Choose the exact SVT algorithm of each level by benchmarking
+ * (see svthresh_plan), remembering the result in wisdom.
+ */
+void lrthresh_plan(const struct operator_p_s* op, const char* wisdom)
+{
+	struct lrthresh_data_s* data = (struct lrthresh_data_s*)operator_p_get_data(op);
+
+	for (int l = 0; l < data->levels; l++) {
+
+		enum svthresh_method method = svthresh_plan(data->M[l], data->N[l], wisdom);
+
+		debug_printf(DP_DEBUG1, "Level %d: %s\n", l, svthresh_method_name[method]);
+
+		data->method[l] = method;
+
+		for (int t = 0; t < data->nthreads; t++)
+			if (NULL != data->ws[t * data->levels + l])
+				svthresh_work_set_method(data->ws[t * data->levels + l], method);
+	}
+}
+
+
+
+/**
+ * Freeze levels whose output was zero in prune_after consecutive
+ * calls: their blocks are neither gathered nor thresholded and the
+ * output level is cleared. Every recheck calls after freezing, a
+ * level is processed again and re-activated if any block survives.
+ *
+ * Iterative solvers start from zero, so the first calls return zero
+ * on all levels. Zero calls of a level are only counted once it had
+ * a nonzero output, or, for levels which stay empty, recheck calls
+ * after the first nonzero output on any level.
+ */
+void lrthresh_set_prune(const struct operator_p_s* op, int prune_after, int recheck)
+{
+	struct lrthresh_data_s* data = (struct lrthresh_data_s*)operator_p_get_data(op);
+
+	assert(recheck > 0);
+
+	data->prune_after = prune_after;
+	data->recheck = recheck;
+}
+
+
+/**
+ * Distribute the blocks over nprocs processes (MPI): the blocks of
+ * all levels are enumerated as in lrthresh_apply and block j is
+ * thresholded by process j % nprocs. By default the output is then
+ * assembled by an all-reduce. With partial, it only contains the own
+ * blocks and is zero elsewhere, which is left to the caller. This
+ * requires fixed blocks (no random shifts).
+ *
+ * Blocks which wrap around the image also read elements owned by
+ * other processes. In partial mode, the input there is taken to be
+ * the last output plus a part which all processes share (as for
+ * Z = X + D in lrdecom), so only the output on the wrapped-around
+ * elements is exchanged and added to the next input.
+ */
+void lrthresh_set_partition(const struct operator_p_s* op, int rank, int nprocs, bool partial)
+{
+	struct lrthresh_data_s* data = (struct lrthresh_data_s*)operator_p_get_data(op);
+
+	assert((0 <= rank) && (rank < nprocs));
+	assert(!(partial && (data->randshift || (1 < data->nshifts))));
+
+	data->proc = rank;
+	data->nprocs = nprocs;
+	data->partial = partial;
+}
+
+
+/**
+ * Cycle spinning: threshold the blocks of each level at nshifts
+ * shifts and average the results, instead of a single (random) shift
+ * per call. The shifts are spread evenly over the block size. With
+ * random shifts, the whole set is moved by a random offset in each
+ * call, drawn from a generator with the given seed, so results do
+ * not depend on other users of rand() or on the number of threads.
+ */
+void lrthresh_set_cyclespin(const struct operator_p_s* op, int nshifts, unsigned int seed)
+{
+	struct lrthresh_data_s* data = (struct lrthresh_data_s*)operator_p_get_data(op);
+
+	assert(0 < nshifts);
+	assert(!data->partial);
+
+	data->nshifts = nshifts;
+	data->seeded = true;
+	data->seed = seed;
+}
+
+
+/**
+ * Keep the copies of all levels needed for in-place calls and
+ * cycle spinning in scratch files in dir (see scratch_cfl).
+ */
+void lrthresh_set_scratch(const struct operator_p_s* op, const char* dir)
+{
+	struct lrthresh_data_s* data = (struct lrthresh_data_s*)operator_p_get_data(op);
+
+	assert((NULL == data->tmp_src) && (NULL == data->tmp_spin));
+	assert(!data->use_gpu);
+
+	data->scratch = dir;
+}
+
+
+bool lrthresh_is_partial(const struct operator_p_s* op)
+{
+	const struct lrthresh_data_s* data = operator_p_get_data(op);
+
+	return data->partial && (data->nprocs > 1);
 }
 
 
 
 /*
- * Return a random number between 0 and limit inclusive.
+ * The elements of level l which wrapping blocks read again (from the
+ * start of each dimension, as the blocks are not shifted), as disjoint
+ * boxes: box i starts at zero in dimension i and after the wrapped
+ * part in the dimensions before. Packs x into h, or adds h to x.
+ * Returns the number of elements (nothing is copied if h is NULL).
  */
-static int rand_lim(int limit)
+static long lrthresh_halo(const struct lrthresh_data_s* data, int l, bool add, complex float* h, complex float* x)
+{
+	long strs[DIMS];
+	md_calc_strides(DIMS, strs, data->dims, CFL_SIZE);
+
+	long wdims[DIMS];
+
+	for (unsigned int i = 0; i < DIMS; i++)
+		wdims[i] = data->zpad_dims[l][i] - data->dims[i];
+
+	long size = 0;
+
+	for (unsigned int i = 0; i < DIMS; i++) {
+
+		if (0 == wdims[i])
+			continue;
+
+		long hdims[DIMS];
+		long pos[DIMS];
+
+		for (unsigned int j = 0; j < DIMS; j++) {
+
+			hdims[j] = (j < i) ? (data->dims[j] - wdims[j]) : ((j == i) ? wdims[i] : data->dims[j]);
+			pos[j] = (j < i) ? wdims[j] : 0;
+		}
+
+		long hstrs[DIMS];
+		md_calc_strides(DIMS, hstrs, hdims, CFL_SIZE);
+
+		if (NULL != h) {
+
+			complex float* xh = &MD_ACCESS(DIMS, strs, pos, x);
+
+			if (add)
+				md_zadd2(DIMS, hdims, strs, xh, strs, xh, hstrs, h + size);
+			else
+				md_copy2(DIMS, hdims, hstrs, h + size, strs, xh, CFL_SIZE);
+		}
+
+		size += md_calc_size(DIMS, hdims);
+	}
+
+	return size;
+}
+
+
+
+/*
+ * Partial mode: gather the output of the other processes
+ * on the elements read by wrapping blocks.
+ */
+static void lrthresh_halo_exchange(struct lrthresh_data_s* data, const complex float* dst)
+{
+	long strs1[DIMS];
+	md_calc_strides(DIMS, strs1, data->dims_decom, 1);
+
+	for (int l = 0; l < data->levels; l++) {
+
+		long size = lrthresh_halo(data, l, false, NULL, NULL);
+
+		if (0 == size)
+			continue;
+
+		if (NULL == data->halo[l])
+			data->halo[l] = md_alloc(1, MD_DIMS(size), CFL_SIZE);
+
+		complex float* own = md_alloc(1, MD_DIMS(size), CFL_SIZE);
+
+		lrthresh_halo(data, l, false, own, (complex float*)dst + l * strs1[LEVEL_DIM]);
+
+		md_copy(1, MD_DIMS(size), data->halo[l], own, CFL_SIZE);
+		mpi_allreduce_sum(2 * size, (float*)data->halo[l]);
+		md_zsub(1, MD_DIMS(size), data->halo[l], data->halo[l], own);
+
+		md_free(own);
+	}
+}
+
+
+
+static bool level_skipped(const struct lrthresh_data_s* data, int l, long call)
+{
+	return data->frozen[l] && (0 != (call - data->frozen_at[l]) % data->recheck);
+}
+
+
+/**
+ * Levels which will be skipped (and set to zero) in the next call
+ *
+ * returns number of levels
+ */
+int lrthresh_get_skipped(const struct operator_p_s* o, bool skip[MAX_LEV])
+{
+	const struct lrthresh_data_s* data = operator_p_get_data(o);
+
+	for (int l = 0; l < data->levels; l++)
+		skip[l] = level_skipped(data, l, data->ncalls + 1);
+
+	return data->levels;
+}
+
+
+/**
+ * Report nuclear norm and pruning state of each level
+ */
+void lrthresh_report(const struct operator_p_s* o)
+{
+	const struct lrthresh_data_s* data = operator_p_get_data(o);
+
+	for (int l = 0; l < data->levels; l++)
+		debug_printf(DP_INFO, "Level %d: nuclear norm %e, %s, skipped in %ld/%ld calls\n", l,
+				data->level_nucnorm[l], data->frozen[l] ? "frozen" : "active",
+				data->skipped[l], data->ncalls);
+}
+
+
+
+/*
+ * Exact SVT of a real-valued block stored as complex: the real parts
+ * are packed to the front of blk and unpacked after thresholding.
+ */
+static long block_svthresh_packed(struct svthresh_work_s* ws, long MN, float lambda, complex float* blk)
+{
+	float* rblk = (float*)blk;
+
+	for (long i = 0; i < MN; i++)
+		rblk[i] = crealf(blk[i]);
+
+	long rank = block_svthresh_real(ws, lambda, rblk, rblk);
+
+	for (long i = MN - 1; i >= 0; i--)
+		blk[i] = rblk[i];
+
+	return rank;
+}
+
+
+
+/**
+ * LAPACK workspace of thread t for level l. Only the calling
+ * thread accesses its workspaces, so no locking is needed.
+ */
+static struct svthresh_work_s* lrthresh_work(struct lrthresh_data_s* data, int t, int l)
+{
+	struct svthresh_work_s** ws = &data->ws[t * data->levels + l];
+
+	if (NULL == *ws) {
+
+		*ws = svthresh_work_create(data->M[l], data->N[l]);
+
+		if (SVT_METHOD_AUTO != data->method[l])
+			svthresh_work_set_method(*ws, data->method[l]);
+	}
+
+	return *ws;
+}
+
+
+
+/*
+ * Return a random number between 0 and limit inclusive,
+ * using rand_r(state) or rand() if state is NULL.
+ */
+static int rand_lim(unsigned int* state, int limit)
 {
 	int divisor = RAND_MAX / (limit + 1);
 	int retval;
 
 	do { 
-		retval = rand() / divisor;
+		retval = ((NULL != state) ? rand_r(state) : rand()) / divisor;
 
 	} while (retval > limit);
 
@@ -155,8 +824,66 @@ static int rand_lim(int limit)
 
 
 
+/*
+ * Per level counters of one call: time in gather/scatter and SVT
+ * (summed over threads, in ms), active blocks, mean rank and the
+ * approximate cost of a full SVD of all active blocks
+ */
+static void lrthresh_trace(const struct lrthresh_data_s* data, const bool skip[], const double tcas[], const double tsvt[], bool dist, const long offset[])
+{
+	int levels = data->levels;
+
+	for (int l = 0; l < levels; l++) {
+
+		if (skip[l])
+			continue;
+
+		long nactive = 0;
+		long rsum = 0;
+
+		for (long b = 0; b < data->B[l]; b++) {
+
+			if (dist && (data->proc != (offset[levels - 1 - l] + b) % data->nprocs))
+				continue;
+
+			if (data->active[l][b]) {
+
+				nactive++;
+				rsum += data->rank[l][b];
+			}
+		}
+
+		long M = data->M[l];
+		long N = data->N[l];
+
+		TRACE_COUNTER(1.E-3 * tcas[l], "level %d casorati ms", l);
+		TRACE_COUNTER(1.E-3 * tsvt[l], "level %d svt ms", l);
+		TRACE_COUNTER(nactive, "level %d active blocks", l);
+		TRACE_COUNTER((0 < nactive) ? ((double)rsum / nactive) : 0., "level %d mean rank", l);
+		TRACE_COUNTER(4. * nactive * M * N * MIN(M, N), "level %d svd flops", l);
+	}
+}
+
+
+
 /*
  * Low rank threhsolding for arbitrary block sizes
+ *
+ * The blocks of all levels are thresholded in one parallel loop (coarse
+ * levels first, for load balancing), each thread using its own LAPACK
+ * workspace. Each block is gathered from the input into its Casorati
+ * matrix and scattered back into the output with fused kernels, which
+ * apply the circular extension and random shift by index tables.
+ * Random shifts are drawn serially beforehand and every block is owned
+ * by exactly one thread, so the result is bit-identical to a
+ * single-threaded run.
+ *
+ * Blocks with a Frobenius norm below the threshold are set to zero
+ * without an SVD. Blocks which were zero in the last call are checked
+ * directly in the input and are only reshaped if they became active.
+ * Frozen levels are skipped altogether (see lrthresh_set_prune).
+ *
+ * Workspaces are allocated on first use and reused in later calls.
  */
 static void lrthresh_apply(const void* _data, float mu, complex float* dst, const complex float* src)
 {
@@ -167,106 +894,354 @@ static void lrthresh_apply(const void* _data, float mu, complex float* dst, cons
 	long strs1[DIMS];
 	md_calc_strides(DIMS, strs1, data->dims_decom, 1);
 
-//#pragma omp parallel for
-	for (int l = 0; l < data->levels; l++) {
+	int levels = data->levels;
 
-		complex float* dstl = dst + l * strs1[LEVEL_DIM];
-		const complex float* srcl = src + l * strs1[LEVEL_DIM];
+	long call = ++data->ncalls;
 
-		// Initialize
-		long blkdims[DIMS];
-		long shifts[DIMS];
-		long unshifts[DIMS];
-		long zpad_dims[DIMS];
-		long M = 1;
+	TRACE_BEGIN();
 
-		for (unsigned int i = 0; i < DIMS; i++) {
+	// per level time spent in gather/scatter and SVT (summed over threads)
+	double tcas[levels];
+	double tsvt[levels];
 
-			blkdims[i] = data->blkdims[l][i];
-			zpad_dims[i] = (data->dims[i] + blkdims[i] - 1) / blkdims[i];
-			zpad_dims[i] *= blkdims[i];
+	for (int l = 0; l < levels; l++) {
 
-			if (MD_IS_SET(data->mflags, i))
-				M *= blkdims[i];
+		tcas[l] = 0.;
+		tsvt[l] = 0.;
+	}
+
+	bool skip[levels];
+
+	for (int l = 0; l < levels; l++) {
+
+		skip[l] = level_skipped(data, l, call);
+		data->last_skip[l] = skip[l];
+
+		if (skip[l])
+			data->skipped[l]++;
+	}
+
+	int nshifts = data->nshifts;
+
+	float lambdas[levels];
+	long maxshift[levels][DIMS];
+	long offs[levels][DIMS];	// offset of the shifts of this call
+
+	for (int l = 0; l < levels; l++) {
+
+		const long* blkdims = data->blkdims[l];
+
+		for (unsigned int i = 0; i < DIMS; i++) {
+
+			maxshift[l][i] = MAX(0, MIN(blkdims[i] - 1, data->zpad_dims[l][i] - blkdims[i]));
 
 			if (data->randshift)
-				shifts[i] = rand_lim(MIN(blkdims[i] - 1, zpad_dims[i] - blkdims[i]));
+				offs[l][i] = rand_lim(data->seeded ? &data->seed : NULL, maxshift[l][i]);
 			else
-				shifts[i] = 0;
+				offs[l][i] = 0;
+		}
+
+		lambdas[l] = lambda * GWIDTH(data->M[l], data->N[l], data->B[l]);
+	}
 
-			unshifts[i] = -shifts[i];
+	bool dist = (data->nprocs > 1);
+	bool halo = dist && data->partial && data->wrap;
+
+	// blocks read copies of elements owned by other blocks (or processes, or shifts)
+	if (((src == dst) && (data->wrap || dist || (1 < nshifts))) || halo) {
+
+		if (NULL == data->tmp_src)
+			data->tmp_src = lrthresh_alloc_levels(data);
+
+		md_copy(DIMS, data->dims_decom, data->tmp_src, src, CFL_SIZE);
+
+		// complete the input with the output of other processes
+		for (int l = 0; l < levels; l++)
+			if (halo && (NULL != data->halo[l]))
+				lrthresh_halo(data, l, true, data->halo[l], data->tmp_src + l * strs1[LEVEL_DIM]);
+
+		src = data->tmp_src;
+	}
+
+	// Threshold blocks of all levels, starting with the coarsest
+	long offset[levels + 1];
+	offset[0] = 0;
+
+	for (int k = 0; k < levels; k++)
+		offset[k + 1] = offset[k] + (skip[levels - 1 - k] ? 0 : data->B[levels - 1 - k]);
+
+	// statistics over the own blocks (mean over all shifts)
+	float stats[levels][2];
+
+	for (int l = 0; l < levels; l++) {
+
+		stats[l][0] = 0.;
+		stats[l][1] = 0.;
+	}
+
+	for (int s = 0; s < nshifts; s++) {
+
+		complex float* out = dst;
+
+		// further shifts are accumulated in dst
+		if (0 < s) {
+
+			if (NULL == data->tmp_spin)
+				data->tmp_spin = lrthresh_alloc_levels(data);
+
+			out = data->tmp_spin;
 		}
 
-		long zpad_strs[DIMS];
-		md_calc_strides(DIMS, zpad_strs, zpad_dims, CFL_SIZE);
+		for (int l = 0; l < levels; l++) {
 
-		long blk_size = md_calc_size( DIMS, blkdims );
-		long img_size = md_calc_size( DIMS, zpad_dims );
-		long N = blk_size / M;
-		long B = img_size / blk_size;
+			for (unsigned int i = 0; i < DIMS; i++)
+				data->shift[l][i] = (offs[l][i] + (s * data->blkdims[l][i]) / nshifts) % (maxshift[l][i] + 1);
 
-		if (data->noise && (l == data->levels - 1)) {
+			basorati_circ_index(DIMS, data->gidx[l], data->sidx[l], data->zpad_dims[l], data->shift[l], data->dims, data->strs_lev);
+		}
+
+		// other processes fill in their blocks
+		if (dist) {
 
-			M = img_size;
-			N = 1;
-			B = 1;
+			md_clear(DIMS, data->dims_decom, out, CFL_SIZE);
+
+		} else {
+
+			for (int l = 0; l < levels; l++)
+				if (skip[l])
+					md_clear(DIMS, data->dims, out + l * strs1[LEVEL_DIM], CFL_SIZE);
 		}
 
-		
-		// Initialize tmp
-		complex float* tmp_ext;
-#ifdef USE_CUDA
-		tmp_ext = (data->use_gpu ? md_alloc_gpu : md_alloc)(DIMS, zpad_dims, CFL_SIZE);
+		#pragma omp parallel num_threads(data->nthreads)
+		{
+#ifdef _OPENMP
+			int t = omp_get_thread_num();
 #else
-		tmp_ext = md_alloc(DIMS, zpad_dims, CFL_SIZE);
+			int t = 0;
 #endif
+			struct svthresh_rand_s** rws = (NULL != data->rws) ? (data->rws + t * levels) : NULL;
 
-		complex float* tmp;
-#ifdef USE_CUDA
-		tmp = (data->use_gpu ? md_alloc_gpu : md_alloc)(DIMS, zpad_dims, CFL_SIZE);
-#else
-		tmp = md_alloc(DIMS, zpad_dims, CFL_SIZE);
-#endif
-		// Copy to tmp
-		md_circ_ext(DIMS, zpad_dims, tmp_ext, data->dims, srcl, CFL_SIZE);
+			complex float* blk = data->tmp_blk + t * data->max_blk;
 
-		if (data->randshift)
-			md_circ_shift(DIMS, zpad_dims, shifts, tmp, tmp_ext, CFL_SIZE);
+			double ltcas[levels];
+			double ltsvt[levels];
 
-		// Initialize tmp_mat
-		long mat_dims[2];
-		basorati_dims(DIMS, mat_dims, blkdims, zpad_dims);
+			for (int l = 0; l < levels; l++) {
 
-		complex float* tmp_mat;
-#ifdef USE_CUDA
-		tmp_mat = (data->use_gpu ? md_alloc_gpu : md_alloc)(2, mat_dims, CFL_SIZE);
-#else
-		tmp_mat = md_alloc(2, mat_dims, CFL_SIZE);
-#endif
-		// Reshape image into a blk_size x number of blocks matrix
+				ltcas[l] = 0.;
+				ltsvt[l] = 0.;
+			}
 
-		basorati_matrix(DIMS, blkdims, mat_dims, tmp_mat, zpad_dims, zpad_strs, tmp);
+			int k = 0;
 
-		batch_svthresh(M, N, mat_dims[1], lambda * GWIDTH(M, N, B), tmp_mat, tmp_mat);
+			#pragma omp for schedule(dynamic)
+			for (long j = 0; j < offset[levels]; j++) {
 
-		//	for ( int b = 0; b < mat_dims[1]; b++ )
-		//	svthresh(M, N, lambda * GWIDTH(M, N, B), tmp_mat, tmp_mat);
+				while (j < offset[k])
+					k--;
 
-		basorati_matrixH(DIMS, blkdims, zpad_dims, zpad_strs, tmp, mat_dims, tmp_mat);
+				while (j >= offset[k + 1])
+					k++;
 
+				if (dist && (data->proc != j % data->nprocs))
+					continue;
 
-		// Copy to tmp
+				int l = levels - 1 - k;
+				long b = j - offset[k];
 
-		if (data->randshift)
-			md_circ_shift(DIMS, zpad_dims, unshifts, tmp_ext, tmp, CFL_SIZE);
+				const complex float* srcl = src + l * strs1[LEVEL_DIM];
+				complex float* dstl = out + l * strs1[LEVEL_DIM];
 
-		md_resize(DIMS, data->dims, dstl, zpad_dims, tmp_ext, CFL_SIZE);
+				long pos[DIMS];
+				long bb = b;
 
-		// Free data
-		md_free(tmp);
-		md_free(tmp_ext);
-		md_free(tmp_mat);
+				for (unsigned int i = 0; i < DIMS; i++) {
+
+					pos[i] = bb % data->grid_dims[l][i];
+					bb /= data->grid_dims[l][i];
+				}
+
+				const long* blkdims = data->blkdims[l];
+				const long** gidx = (const long**)data->gidx[l];
+				const long** sidx = (const long**)data->sidx[l];
+
+				float lsq = lambdas[l] * lambdas[l];
+
+				double t0 = trace_on ? trace_time() : 0.;
+
+				// |A|_F bounds the largest singular value
+				if (   (!data->active[l][b] && (basorati_gather_block(DIMS, blkdims, pos, gidx, NULL, srcl) < lsq))
+				    || (basorati_gather_block(DIMS, blkdims, pos, gidx, blk, srcl) < lsq)) {
+
+					basorati_scatter_block(DIMS, blkdims, pos, sidx, dstl, NULL);
+
+					data->rank[l][b] = 0;
+					data->active[l][b] = false;
+					data->nucnorm[l][b] = 0.;
+
+					if (trace_on)
+						ltcas[l] += trace_time() - t0;
+
+					continue;
+				}
+
+				double t1 = trace_on ? trace_time() : 0.;
+
+				long rank = -1;
+
+				struct svthresh_work_s* ws = lrthresh_work(data, t, l);
+
+				unsigned int seed = l * data->B[l] + b + 1;
+
+				bool approx = (SVT_EXACT != data->backend[l]) && (data->rank[l][b] >= 0);
+
+				// same early-out as the exact SVT, so that all backends agree on zero blocks
+				if (approx && (svthresh_bound(ws, blk) < lsq)) {
+
+					md_clear(1, MD_DIMS(data->M[l] * data->N[l]), blk, CFL_SIZE);
+
+					rank = 0;
+					approx = false;
+				}
+
+				if (approx && (SVT_RANDOMIZED == data->backend[l]))
+					rank = svthresh_rand(rws[l], data->rank[l][b], seed, lambdas[l], blk, blk);
+
+				float nn = 0.;
+
+				if (approx && (SVT_WARMSTART == data->backend[l])) {
+
+					long csize = svthresh_warm_cachesize(rws[l]);
+
+					rank = svthresh_warm(rws[l], data->rank[l][b], &data->ncached[l][b], data->vcache[l] + b * csize, seed, lambdas[l], blk, blk);
+				}
+
+				if (rank > 0)
+					nn = svthresh_rand_nucnorm(rws[l], rank, lambdas[l]);
+
+				// fall back to exact SVT
+				if (rank < 0) {
+
+					if (data->real)
+						rank = block_svthresh_packed(ws, data->M[l] * data->N[l], lambdas[l], blk);
+					else
+						rank = block_svthresh(ws, lambdas[l], blk, blk);
+
+					nn = svthresh_work_nucnorm(ws, rank, lambdas[l]);
+				}
+
+				double t2 = trace_on ? trace_time() : 0.;
+
+				basorati_scatter_block(DIMS, blkdims, pos, sidx, dstl, blk);
+
+				data->rank[l][b] = rank;
+				data->active[l][b] = (0 != rank);
+				data->nucnorm[l][b] = nn;
+
+				if (trace_on) {
+
+					ltcas[l] += (t1 - t0) + (trace_time() - t2);
+					ltsvt[l] += t2 - t1;
+				}
+			}
+
+			if (trace_on) {
+
+				#pragma omp critical (lrthresh_trace)
+				for (int l = 0; l < levels; l++) {
+
+					tcas[l] += ltcas[l];
+					tsvt[l] += ltsvt[l];
+				}
+			}
+		}
+
+		for (int l = 0; l < levels; l++) {
+
+			if (skip[l])
+				continue;
+
+			for (long b = 0; b < data->B[l]; b++) {
+
+				if (dist && (data->proc != (offset[levels - 1 - l] + b) % data->nprocs))
+					continue;
+
+				if (data->active[l][b])
+					stats[l][0]++;
+
+				stats[l][1] += data->nucnorm[l][b];
+			}
+		}
+
+		if (0 < s)
+			md_zadd(DIMS, data->dims_decom, dst, dst, out);
+	}
+
+	if (1 < nshifts) {
+
+		md_zsmul(DIMS, data->dims_decom, dst, dst, 1. / nshifts);
+
+		for (int l = 0; l < levels; l++) {
+
+			stats[l][0] /= nshifts;
+			stats[l][1] /= nshifts;
+		}
+	}
+
+	if (dist) {
+
+		mpi_allreduce_sum(2 * levels, &stats[0][0]);
+
+		if (!data->partial)
+			mpi_allreduce_sum(2 * md_calc_size(DIMS, data->dims_decom), (float*)dst);
+		else if (halo)
+			lrthresh_halo_exchange(data, dst);
+	}
+
+	debug_printf(DP_DEBUG3, "lrthresh active blocks:");
+
+	for (int l = 0; l < levels; l++)
+		if ((0 == data->first_active) && (0. < stats[l][0]))
+			data->first_active = call;
+
+	for (int l = 0; l < levels; l++) {
+
+		long nactive = ceilf(stats[l][0]);
+
+		data->level_nucnorm[l] = stats[l][1];
+
+		debug_printf(DP_DEBUG3, "\t%ld/%ld", nactive, data->B[l]);
+
+		if (skip[l] || (data->prune_after <= 0))
+			continue;
+
+		if (0 < nactive)
+			data->was_active[l] = true;
+
+		bool warm = data->was_active[l] || ((0 < data->first_active) && (call >= data->first_active + data->recheck));
+
+		data->zero_calls[l] = ((0 == nactive) && warm) ? (data->zero_calls[l] + 1) : 0;
+
+		if (data->frozen[l] && (0 < nactive)) {
+
+			data->frozen[l] = false;
+			debug_printf(DP_DEBUG1, "Level %d re-activated after %ld calls\n", l, call);
+		}
+
+		if (!data->frozen[l] && (data->zero_calls[l] >= data->prune_after)) {
+
+			data->frozen[l] = true;
+			data->frozen_at[l] = call;
+			debug_printf(DP_DEBUG1, "Level %d frozen after %ld calls\n", l, call);
+		}
 	}
+
+	debug_printf(DP_DEBUG3, "\n");
+
+	if (trace_on)
+		lrthresh_trace(data, skip, tcas, tsvt, dist, offset);
+
+	TRACE_END(0., 0., "lrthresh");
 }
 
 
@@ -461,6 +1436,93 @@ long ls_blkdims(long blkdims[MAX_LEV][DIMS], const long idims[DIMS])
 }
 
 
+/**
+ * Nuclear norm of each level of the output of the last call
+ * (sum over blocks), as computed by the thresholding itself.
+ *
+ * returns number of levels
+ */
+int lrthresh_get_nucnorm(const struct operator_p_s* o, float nucnorm[MAX_LEV])
+{
+	const struct lrthresh_data_s* data = operator_p_get_data(o);
+
+	for (int l = 0; l < data->levels; l++)
+		nucnorm[l] = data->level_nucnorm[l];
+
+	return data->levels;
+}
+
+
+/**
+ * Collect the ranks of the blocks of the last call on the first
+ * process (MPI), so that lrthresh_get_geom returns all of them.
+ * Must be called by all processes after the last call.
+ */
+void lrthresh_gather_ranks(const struct operator_p_s* o)
+{
+	struct lrthresh_data_s* data = (struct lrthresh_data_s*)operator_p_get_data(o);
+
+	if (1 == data->nprocs)
+		return;
+
+	int levels = data->levels;
+	long offset = 0;
+
+	// blocks are enumerated as in lrthresh_apply, coarsest level first
+	for (int k = 0; k < levels; k++) {
+
+		int l = levels - 1 - k;
+		bool skip = data->last_skip[l];
+
+		float* rank = xmalloc(data->B[l] * sizeof(float));
+
+		for (long b = 0; b < data->B[l]; b++)
+			rank[b] = (!skip && (data->proc == (offset + b) % data->nprocs)) ? data->rank[l][b] : 0.;
+
+		mpi_reduce_sum(data->B[l], rank);
+
+		if (0 == data->proc)
+			for (long b = 0; b < data->B[l]; b++)
+				data->rank[l][b] = rank[b];
+
+		free(rank);
+
+		if (!skip)
+			offset += data->B[l];
+	}
+
+	data->ranks_gathered = true;
+}
+
+
+
+/**
+ * Block geometry of each level, with the shifts and the
+ * ranks of the blocks of the last call (see lrthresh_gather_ranks)
+ */
+int lrthresh_get_geom(const struct operator_p_s* o, struct lrthresh_geom_s geom[MAX_LEV])
+{
+	const struct lrthresh_data_s* data = operator_p_get_data(o);
+
+	for (int l = 0; l < data->levels; l++) {
+
+		geom[l].M = data->M[l];
+		geom[l].N = data->N[l];
+		geom[l].B = data->B[l];
+
+		md_copy_dims(DIMS, geom[l].blkdims, data->blkdims[l]);
+		md_copy_dims(DIMS, geom[l].zpad_dims, data->zpad_dims[l]);
+		md_copy_dims(DIMS, geom[l].grid_dims, data->grid_dims[l]);
+		md_copy_dims(DIMS, geom[l].shift, data->shift[l]);
+
+		// other processes threshold some of the blocks
+		geom[l].rank = ((1 == data->nprocs) || (data->ranks_gathered && (0 == data->proc))) ? data->rank[l] : NULL;
+	}
+
+	return data->levels;
+}
+
+
 float get_lrthresh_lambda(const struct operator_p_s* o)
 {
 	const struct lrthresh_data_s* data = operator_p_get_data(o);
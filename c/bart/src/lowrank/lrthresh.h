@@ -8,16 +8,52 @@
 
 #include "misc/mri.h"
 
+#include "lowrank/svthresh.h"
+
 #ifndef MAX_LEV
 #define MAX_LEV 100
 #endif
 
 struct operator_p_s;
 
+struct lrthresh_geom_s {
+
+	long M;
+	long N;
+	long B;
+	long blkdims[DIMS];
+	long zpad_dims[DIMS];
+	long grid_dims[DIMS];
+	long shift[DIMS];
+	const long* rank;	// rank of each block in the last call (or NULL)
+};
+
 
 // Low rank thresholding for arbitrary block sizes
 extern const struct operator_p_s* lrthresh_create(const long dims_lev[DIMS], _Bool randshift, unsigned long mflags, const long blkdims[MAX_LEV][DIMS], float lambda, _Bool noise, int remove_mean, _Bool use_gpu);
 
+// Select singular value thresholding backend
+extern void lrthresh_set_backend(const struct operator_p_s* op, enum svthresh_backend backend);
+
+// Select the exact SVT algorithm of each level by benchmarking
+extern void lrthresh_plan(const struct operator_p_s* op, const char* wisdom);
+
+// Use real arithmetic for the exact SVT
+extern void lrthresh_set_real(const struct operator_p_s* op, _Bool real);
+
+// Skip levels which stay zero for prune_after calls, re-checking every recheck calls
+extern void lrthresh_set_prune(const struct operator_p_s* op, int prune_after, int recheck);
+
+// Distribute blocks over processes; with partial, the output only has the own blocks
+extern void lrthresh_set_partition(const struct operator_p_s* op, int rank, int nprocs, _Bool partial);
+extern _Bool lrthresh_is_partial(const struct operator_p_s* op);
+
+// Average over nshifts block shifts per call (cycle spinning), random offsets from seed
+extern void lrthresh_set_cyclespin(const struct operator_p_s* op, int nshifts, unsigned int seed);
+
+// Keep copies of all levels in scratch files in dir
+extern void lrthresh_set_scratch(const struct operator_p_s* op, const char* dir);
+
 // Returns nuclear norm using lrthresh operator
 extern float lrnucnorm(const struct operator_p_s* op, const complex float* src);
 
@@ -35,3 +71,18 @@ extern void add_lrnoiseblk(long* level, long blkdims[MAX_LEV][DIMS], const long
 
 // Return the regularization parameter
 extern float get_lrthresh_lambda(const struct operator_p_s* o);
+
+// Return the block geometry of each level (with the shifts of the last call)
+extern int lrthresh_get_geom(const struct operator_p_s* o, struct lrthresh_geom_s geom[MAX_LEV]);
+
+// Collect the block ranks of the last call on the first process (MPI)
+extern void lrthresh_gather_ranks(const struct operator_p_s* o);
+
+// Return the nuclear norm of each level after the last call
+extern int lrthresh_get_nucnorm(const struct operator_p_s* o, float nucnorm[MAX_LEV]);
+
+// Return the levels which are skipped in the next call
+extern int lrthresh_get_skipped(const struct operator_p_s* o, _Bool skip[MAX_LEV]);
+
+// Print nuclear norm and pruning state of each level
+extern void lrthresh_report(const struct operator_p_s* o);
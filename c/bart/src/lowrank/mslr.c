@@ -0,0 +1,210 @@
+/* Copyright 2026. The Regents of the University of California.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ *
+ * Authors:
+ * 2026 agent <agent@local>
+ *
+ * The arrays are passed with arbitrary strides, so that callers
+ * (e.g. NumPy) can hand over their buffers. The solver (the folded
+ * ADMM, lrdecom) works on them directly if they are in Fortran order
+ * and on contiguous copies otherwise. Errors are returned to the
+ * caller instead of aborting the host process.
+ */
+
+#include <complex.h>
+#include <stdbool.h>
+#include <setjmp.h>
+
+#include "misc/misc.h"
+#include "misc/mri.h"
+#include "misc/debug.h"
+
+#include "num/multind.h"
+#include "num/flpmath.h"
+#include "num/ops.h"
+#include "num/init.h"
+
+#include "lowrank/lrthresh.h"
+#include "lowrank/lrdecom.h"
+
+#include "mslr.h"
+
+
+const struct mslr_conf mslr_defaults = {
+
+	.maxiter = 100,
+	.rho = 0.25,
+	.blkskip = 2,
+	.initblk = 1,
+	.mflags = 1,
+	.flags = ~0ul,
+	.randshift = true,
+	.noise = false,
+	.completion = false,
+	.hogwild = false,
+	.remove_mean = 0,
+	.check_every = 0,
+	.tol = 0.,
+	.prune_after = 0,
+};
+
+
+
+static int mslr_blkdims(const struct mslr_conf* conf, unsigned int D, const long dims[], long idims[DIMS], long blkdims[MAX_LEV][DIMS])
+{
+	if ((D > LEVEL_DIM) || (conf->blkskip < 2) || (conf->initblk < 1))
+		return -1;
+
+	for (unsigned int i = 0; i < DIMS; i++)
+		idims[i] = (i < D) ? dims[i] : 1;
+
+	for (unsigned int i = 0; i < D; i++)
+		if (dims[i] < 1)
+			return -1;
+
+	long levels = multilr_blkdims(blkdims, conf->flags & ~LEVEL_FLAG, idims, conf->blkskip, conf->initblk);
+
+	if (conf->noise)
+		add_lrnoiseblk(&levels, blkdims, idims);
+
+	return levels;
+}
+
+
+
+int mslr_levels(const struct mslr_conf* conf, unsigned int D, const long dims[])
+{
+	long idims[DIMS];
+	long blkdims[MAX_LEV][DIMS];
+
+	return mslr_blkdims(conf, D, dims, idims, blkdims);
+}
+
+
+
+static bool mslr_contiguous(const long dims[DIMS], const long strs[DIMS], const long cstrs[DIMS])
+{
+	for (unsigned int i = 0; i < DIMS; i++)
+		if ((1 < dims[i]) && (strs[i] != cstrs[i]))
+			return false;
+
+	return true;
+}
+
+
+
+int mslr_decompose(const struct mslr_conf* conf, unsigned int D, const long dims[],
+		const long ostrs[], complex float* out, const long istrs[], const complex float* in)
+{
+	num_init();
+
+	long idims[DIMS];
+	long blkdims[MAX_LEV][DIMS];
+
+	int levels = mslr_blkdims(conf, D, dims, idims, blkdims);
+
+	if (levels < 0)
+		return -1;
+
+	long odims[DIMS];
+	md_copy_dims(DIMS, odims, idims);
+	odims[LEVEL_DIM] = levels;
+
+	// caller strides, with the levels in LEVEL_DIM
+	long istrs1[DIMS];
+	long ostrs1[DIMS];
+
+	for (unsigned int i = 0; i < DIMS; i++) {
+
+		istrs1[i] = (i < D) ? istrs[i] : 0;
+		ostrs1[i] = (i < D) ? ostrs[i] : 0;
+	}
+
+	ostrs1[LEVEL_DIM] = ostrs[D];
+
+	long istrs2[DIMS];
+	long ostrs2[DIMS];
+	md_calc_strides(DIMS, istrs2, idims, CFL_SIZE);
+	md_calc_strides(DIMS, ostrs2, odims, CFL_SIZE);
+
+	bool icopy = !mslr_contiguous(idims, istrs1, istrs2);
+	bool ocopy = !mslr_contiguous(odims, ostrs1, ostrs2);
+
+	// buffers owned here, released if error() returns to env
+	complex float* volatile ibuf = NULL;
+	complex float* volatile obuf = NULL;
+	complex float* volatile pattern = NULL;
+	const struct operator_p_s* volatile lr_prox = NULL;
+
+	jmp_buf env;
+
+	if (0 != setjmp(env)) {
+
+		error_catch(NULL);
+
+		if (NULL != lr_prox)
+			operator_p_free(lr_prox);
+
+		md_free(pattern);
+		md_free(ibuf);
+		md_free(obuf);
+
+		return -1;
+	}
+
+	error_catch(&env);
+
+	const complex float* idata = in;
+	complex float* odata = out;
+
+	if (icopy) {
+
+		ibuf = md_alloc(DIMS, idims, CFL_SIZE);
+		md_copy2(DIMS, idims, istrs2, ibuf, istrs1, in, CFL_SIZE);
+		idata = ibuf;
+	}
+
+	if (ocopy) {
+
+		obuf = md_alloc(DIMS, odims, CFL_SIZE);
+		odata = obuf;
+	}
+
+	debug_printf(DP_DEBUG2, "mslr: copy input %d, output %d\n", icopy, ocopy);
+
+	md_clear(DIMS, odims, odata, CFL_SIZE);
+
+	if (conf->completion) {
+
+		pattern = md_alloc(DIMS, idims, CFL_SIZE);
+		estimate_pattern(DIMS, idims, TIME_DIM, pattern, idata);
+	}
+
+	lr_prox = lrthresh_create(odims, conf->randshift, conf->mflags, (const long (*)[])blkdims, 1., conf->noise, conf->remove_mean, false);
+
+	if (conf->prune_after > 0)
+		lrthresh_set_prune(lr_prox, conf->prune_after, 5 * conf->prune_after);
+
+	struct lrdecom_conf dconf = lrdecom_defaults;
+	dconf.maxiter = conf->maxiter;
+	dconf.rho = conf->rho;
+	dconf.hogwild = conf->hogwild;
+	dconf.check_every = conf->check_every;
+	dconf.tol = conf->tol;
+
+	lrdecom(&dconf, odims, odata, idata, pattern, lr_prox);
+
+	if (ocopy)
+		md_copy2(DIMS, odims, ostrs1, out, ostrs2, odata, CFL_SIZE);
+
+	error_catch(NULL);
+
+	operator_p_free(lr_prox);
+
+	md_free(pattern);
+	md_free(ibuf);
+	md_free(obuf);
+
+	return 0;
+}
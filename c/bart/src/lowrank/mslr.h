@@ -0,0 +1,53 @@
+/* Copyright 2026. The Regents of the University of California.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ *
+ * In-process entry point for the multi-scale low rank decomposition
+ * (as lrmatrix -a), for use from other programs through libbart.so.
+ * Only plain C types are used, so the interface does not depend on
+ * internal headers.
+ */
+
+#ifndef __MSLR_H
+#define __MSLR_H
+
+#include <complex.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct mslr_conf {
+
+	int maxiter;
+	float rho;
+	int blkskip;
+	long initblk;
+	unsigned long mflags;	// dimensions reshaped to matrix columns
+	unsigned long flags;	// dimensions of the multi-scale partition
+	bool randshift;
+	bool noise;		// add a level for Gaussian noise
+	bool completion;	// zeros are unobserved entries
+	bool hogwild;
+	int remove_mean;
+	unsigned int check_every;
+	double tol;
+	int prune_after;
+};
+
+extern const struct mslr_conf mslr_defaults;
+
+// Number of levels for an array of D <= 12 dimensions (-1 on error)
+extern int mslr_levels(const struct mslr_conf* conf, unsigned int D, const long dims[]);
+
+// Decompose in into out, which has dims and one extra dimension for the levels. Strides are in bytes.
+// Returns 0 on success and -1 on error (the contents of out are then undefined).
+extern int mslr_decompose(const struct mslr_conf* conf, unsigned int D, const long dims[],
+		const long ostrs[], _Complex float* out, const long istrs[], const _Complex float* in);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
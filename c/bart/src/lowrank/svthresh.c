@@ -10,6 +10,8 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <complex.h>
 #include <math.h>
 #include <stdbool.h>
@@ -213,6 +215,374 @@ float maxsingular(long M, long N, const complex float* d) {	// FIXME: destroys i
 
 
 
+/***********
+ * Randomized singular value thresholding
+ ************/
+
+#define SVT_RAND_OVERSAMPLE 10
+#define SVT_RAND_POWER 3
+
+#define SVT_RESID_POWER 4
+
+#define SVT_WARM_MAXITER 4
+#define SVT_WARM_TOL 1.E-3
+
+
+struct svthresh_rand_s {
+
+	long M;
+	long N;
+	long L;
+
+	complex float* Omega;	// N x L
+	complex float* Y;	// M x L
+	complex float* Z;	// N x L
+	complex float* W;	// M x L
+	complex float* BB;	// L x N
+	complex float* UB;	// L x L
+	complex float* VT;	// L x N
+	float* S;		// L
+	float* S_old;		// L
+};
+
+
+/**
+ * Workspace for randomized SVT of M x N blocks with
+ * sketches of at most maxrank + oversampling columns
+ */
+struct svthresh_rand_s* svthresh_rand_create(long M, long N, long maxrank)
+{
+	struct svthresh_rand_s* ws = xmalloc(sizeof(struct svthresh_rand_s));
+
+	long L = MIN(maxrank + SVT_RAND_OVERSAMPLE, MIN(M, N));
+
+	ws->M = M;
+	ws->N = N;
+	ws->L = L;
+
+	ws->Omega = xmalloc(N * L * sizeof(complex float));
+	ws->Y = xmalloc(M * L * sizeof(complex float));
+	ws->Z = xmalloc(N * L * sizeof(complex float));
+	ws->W = xmalloc(M * L * sizeof(complex float));
+	ws->BB = xmalloc(L * N * sizeof(complex float));
+	ws->UB = xmalloc(L * L * sizeof(complex float));
+	ws->VT = xmalloc(L * N * sizeof(complex float));
+	ws->S = xmalloc(L * sizeof(float));
+	ws->S_old = xmalloc(L * sizeof(float));
+
+	return ws;
+}
+
+
+void svthresh_rand_free(struct svthresh_rand_s* ws)
+{
+	free(ws->Omega);
+	free(ws->Y);
+	free(ws->Z);
+	free(ws->W);
+	free(ws->BB);
+	free(ws->UB);
+	free(ws->VT);
+	free(ws->S);
+	free(ws->S_old);
+	free(ws);
+}
+
+
+/**
+ * Number of elements of the subspace cache of one block for svthresh_warm
+ */
+long svthresh_warm_cachesize(const struct svthresh_rand_s* ws)
+{
+	return ws->N * ws->L;
+}
+
+
+/**
+ * Nuclear norm of the result of the last svthresh_rand or
+ * svthresh_warm, which returned rank.
+ */
+float svthresh_rand_nucnorm(const struct svthresh_rand_s* ws, long rank, float lambda)
+{
+	float nn = 0.;
+
+	for (long i = 0; i < rank; i++)
+		nn += ws->S[i] - lambda;
+
+	return nn;
+}
+
+
+// uniformly distributed in [-1, 1), reproducible for a given seed
+static float svt_rand(unsigned int* state)
+{
+	*state = *state * 1103515245u + 12345u;
+	return (float)((*state >> 8) & 0xFFFF) / 32768. - 1.;
+}
+
+
+static float svt_norm(long N, const complex float* x)
+{
+	double res = 0.;
+
+	for (long i = 0; i < N; i++)
+		res += crealf(x[i] * conjf(x[i]));
+
+	return sqrt(res);
+}
+
+
+/*
+ * Estimate the largest singular value of the part of A outside of
+ * span(Y) by power iteration on (I - Y Y^H) A. If it is above lambda,
+ * the subspace missed singular values which survive thresholding.
+ * Uses Z, W and BB of the workspace as temporary storage.
+ */
+static float svt_resid_norm(struct svthresh_rand_s* ws, long L, const complex float* src, unsigned int* seed)
+{
+	long M = ws->M;
+	long N = ws->N;
+
+	complex float* x = ws->Z;
+	complex float* y = ws->W;
+	complex float* c = ws->BB;
+
+	complex float one = 1.;
+	complex float mone = -1.;
+	complex float zero = 0.;
+
+	for (long i = 0; i < N; i++)
+		x[i] = svt_rand(seed) + 1.i * svt_rand(seed);
+
+	float sigma = 0.;
+
+	for (int k = 0; k < SVT_RESID_POWER; k++) {
+
+		float xn = svt_norm(N, x);
+
+		if (0. == xn)
+			return 0.;
+
+		complex float scale = 1. / xn;
+
+		// y = (I - Y Y^H) A x / |x|
+		cgemm_sameplace('N', 'N', M, 1, N, &scale, (const complex float (*)[])src, M, (const complex float (*)[])x, N, &zero, (complex float (*)[])y, M);
+		cgemm_sameplace('C', 'N', L, 1, M, &one, (const complex float (*)[])ws->Y, M, (const complex float (*)[])y, M, &zero, (complex float (*)[])c, L);
+		cgemm_sameplace('N', 'N', M, 1, L, &mone, (const complex float (*)[])ws->Y, M, (const complex float (*)[])c, L, &one, (complex float (*)[])y, M);
+
+		sigma = svt_norm(M, y);
+
+		// x = A^H y
+		cgemm_sameplace('C', 'N', N, 1, M, &one, (const complex float (*)[])src, M, (const complex float (*)[])y, M, &zero, (complex float (*)[])x, N);
+	}
+
+	return sigma;
+}
+
+
+/**
+ * Randomized singular value thresholding (Halko, Martinsson, Tropp)
+ *
+ * Finds the range of A with a random sketch of rank + oversampling
+ * columns refined by power iterations, and thresholds the SVD of
+ * the projected matrix. Costs O(MNk) instead of O(MN min(M,N)).
+ *
+ * Returns the number of singular values above lambda, or -1 if the
+ * sketch is too small to contain all of them (or not smaller than the
+ * matrix), as indicated by the smallest sketched singular value or by
+ * the norm of the part of A outside of the sketch. In this case dst is
+ * not touched and the caller should fall back to the exact SVT.
+ *
+ * @param ws - workspace
+ * @param rank - rank estimate, e.g. from the previous iteration
+ * @param seed - seed for the random test matrix
+ * @param lambda - threshold
+ */
+long svthresh_rand(struct svthresh_rand_s* ws, long rank, unsigned int seed, float lambda, complex float* dst, const complex float* src)
+{
+	long M = ws->M;
+	long N = ws->N;
+	long L = MIN(rank + SVT_RAND_OVERSAMPLE, ws->L);
+
+	if (L >= MIN(M, N))
+		return -1;
+
+	complex float one = 1.;
+	complex float zero = 0.;
+
+	for (long i = 0; i < N * L; i++)
+		ws->Omega[i] = svt_rand(&seed) + 1.i * svt_rand(&seed);
+
+	// Y = A Omega
+	cgemm_sameplace('N', 'N', M, L, N, &one, (const complex float (*)[])src, M, (const complex float (*)[])ws->Omega, N, &zero, (complex float (*)[])ws->Y, M);
+
+	// power iterations: Y = (A A^H)^q A Omega
+	for (int q = 0; q < SVT_RAND_POWER; q++) {
+
+		lapack_orthonormalize(M, L, (complex float (*)[])ws->Y);
+
+		cgemm_sameplace('C', 'N', N, L, M, &one, (const complex float (*)[])src, M, (const complex float (*)[])ws->Y, M, &zero, (complex float (*)[])ws->Z, N);
+
+		lapack_orthonormalize(N, L, (complex float (*)[])ws->Z);
+
+		cgemm_sameplace('N', 'N', M, L, N, &one, (const complex float (*)[])src, M, (const complex float (*)[])ws->Z, N, &zero, (complex float (*)[])ws->Y, M);
+	}
+
+	lapack_orthonormalize(M, L, (complex float (*)[])ws->Y);
+
+	// BB = Y^H A
+	cgemm_sameplace('C', 'N', L, N, M, &one, (const complex float (*)[])ws->Y, M, (const complex float (*)[])src, M, &zero, (complex float (*)[])ws->BB, L);
+
+	lapack_svd_econ(L, N, (complex float (*)[])ws->UB, (complex float (*)[])ws->VT, ws->S, (complex float (*)[])ws->BB);
+
+	// singular values beyond the sketch might survive
+	if (ws->S[L - 1] > lambda)
+		return -1;
+
+	if (svt_resid_norm(ws, L, src, &seed) > lambda)
+		return -1;
+
+	long r = 0;
+
+	while ((r < L) && (ws->S[r] > lambda)) {
+
+		for (long j = 0; j < N; j++)
+			ws->VT[r + j * L] *= ws->S[r] - lambda;
+
+		r++;
+	}
+
+	if (0 == r) {
+
+		md_clear(1, MD_DIMS(M * N), dst, CFL_SIZE);
+		return 0;
+	}
+
+	// dst = (Y UB) S VT
+	cgemm_sameplace('N', 'N', M, r, L, &one, (const complex float (*)[])ws->Y, M, (const complex float (*)[])ws->UB, L, &zero, (complex float (*)[])ws->W, M);
+	cgemm_sameplace('N', 'N', M, N, r, &one, (const complex float (*)[])ws->W, M, (const complex float (*)[])ws->VT, L, &zero, (complex float (*)[])dst, M);
+
+	return r;
+}
+
+
+
+/**
+ * Warm-started singular value thresholding
+ *
+ * Subspace iteration with Rayleigh-Ritz extraction, seeded with the
+ * right singular subspace V cached from the previous call for this
+ * block (filled up with random vectors). Sweeps stop when the singular
+ * values above lambda change by less than SVT_WARM_TOL relative to the
+ * largest one. The refined subspace is written back to the cache.
+ *
+ * Returns the number of singular values above lambda, or -1 if the
+ * iteration did not converge or the subspace is too small to contain
+ * all of them. In this case dst is not touched and the caller should
+ * fall back to the exact SVT.
+ *
+ * @param ws - workspace
+ * @param rank - rank estimate, e.g. from the previous iteration
+ * @param ncached - number of valid columns in V (in/out)
+ * @param V - N x L cache of right singular vectors (in/out)
+ * @param seed - seed for the random vectors
+ * @param lambda - threshold
+ */
+long svthresh_warm(struct svthresh_rand_s* ws, long rank, long* ncached, complex float* V, unsigned int seed, float lambda, complex float* dst, const complex float* src)
+{
+	long M = ws->M;
+	long N = ws->N;
+	long L = MIN(rank + SVT_RAND_OVERSAMPLE, ws->L);
+
+	if (L >= MIN(M, N))
+		return -1;
+
+	complex float one = 1.;
+	complex float zero = 0.;
+
+	long nc = MIN(*ncached, L);
+
+	for (long i = 0; i < N * nc; i++)
+		ws->Z[i] = V[i];
+
+	for (long i = N * nc; i < N * L; i++)
+		ws->Z[i] = svt_rand(&seed) + 1.i * svt_rand(&seed);
+
+	bool converged = false;
+
+	for (int k = 0; k < SVT_WARM_MAXITER; k++) {
+
+		// Y = orth(A Z)
+		cgemm_sameplace('N', 'N', M, L, N, &one, (const complex float (*)[])src, M, (const complex float (*)[])ws->Z, N, &zero, (complex float (*)[])ws->Y, M);
+
+		lapack_orthonormalize(M, L, (complex float (*)[])ws->Y);
+
+		// BB = Y^H A
+		cgemm_sameplace('C', 'N', L, N, M, &one, (const complex float (*)[])ws->Y, M, (const complex float (*)[])src, M, &zero, (complex float (*)[])ws->BB, L);
+
+		lapack_svd_econ(L, N, (complex float (*)[])ws->UB, (complex float (*)[])ws->VT, ws->S, (complex float (*)[])ws->BB);
+
+		// Z = VT^H
+		for (long i = 0; i < L; i++)
+			for (long j = 0; j < N; j++)
+				ws->Z[j + i * N] = conjf(ws->VT[i + j * L]);
+
+		if (k > 0) {
+
+			float change = 0.;
+
+			for (long i = 0; (i < L) && (ws->S[i] > lambda); i++)
+				change = MAX(change, fabsf(ws->S[i] - ws->S_old[i]));
+
+			if (change <= SVT_WARM_TOL * ws->S[0]) {
+
+				converged = true;
+				break;
+			}
+		}
+
+		for (long i = 0; i < L; i++)
+			ws->S_old[i] = ws->S[i];
+	}
+
+	// cache subspace for the next call
+	for (long i = 0; i < N * L; i++)
+		V[i] = ws->Z[i];
+
+	*ncached = L;
+
+	// singular values beyond the subspace might survive
+	if (!converged || (ws->S[L - 1] > lambda))
+		return -1;
+
+	if (svt_resid_norm(ws, L, src, &seed) > lambda)
+		return -1;
+
+	long r = 0;
+
+	while ((r < L) && (ws->S[r] > lambda)) {
+
+		for (long j = 0; j < N; j++)
+			ws->VT[r + j * L] *= ws->S[r] - lambda;
+
+		r++;
+	}
+
+	if (0 == r) {
+
+		md_clear(1, MD_DIMS(M * N), dst, CFL_SIZE);
+		return 0;
+	}
+
+	// dst = (Y UB) S VT
+	cgemm_sameplace('N', 'N', M, r, L, &one, (const complex float (*)[])ws->Y, M, (const complex float (*)[])ws->UB, L, &zero, (complex float (*)[])ws->W, M);
+	cgemm_sameplace('N', 'N', M, N, r, &one, (const complex float (*)[])ws->W, M, (const complex float (*)[])ws->VT, L, &zero, (complex float (*)[])dst, M);
+
+	return r;
+}
+
+
+
 /***********
  * Blockproc functions
  ************/
@@ -290,3 +660,236 @@ float nucnorm_blockproc( const void* _data, const long blkdims[DIMS], complex fl
 }
 
 
+
+
+
+// planner: accuracy bound relative to cgesvd_ and minimum time per candidate
+#define SVT_PLAN_TOL 1.E-3
+#define SVT_PLAN_TIME 0.01
+#define SVT_PLAN_JACOBI_MAXSIZE 32
+#define SVT_PLAN_MAXSIZE (1l << 20)	// larger blocks (elements) use the default method
+
+
+static void cpu_name(int len, char buf[len])
+{
+	snprintf(buf, len, "unknown");
+
+	FILE* fp = fopen("/proc/cpuinfo", "r");
+
+	if (NULL == fp)
+		return;
+
+	char line[256];
+
+	while (NULL != fgets(line, sizeof(line), fp)) {
+
+		char* p = strchr(line, ':');
+
+		if ((0 == strncmp(line, "model name", 10)) && (NULL != p)) {
+
+			p += strspn(p + 1, " \t") + 1;
+			p[strcspn(p, "\n")] = '\0';
+
+			snprintf(buf, len, "%s", p);
+			break;
+		}
+	}
+
+	fclose(fp);
+}
+
+
+static bool wisdom_lookup(const char* wisdom, const char* cpu, long M, long N, enum svthresh_method* method)
+{
+	FILE* fp = fopen(wisdom, "r");
+
+	if (NULL == fp)
+		return false;
+
+	bool found = false;
+	char line[512];
+
+	while (!found && (NULL != fgets(line, sizeof(line), fp))) {
+
+		long M2, N2;
+		char name[16];
+		char cpu2[256];
+
+		if (4 != sscanf(line, "%ld %ld %15s %255[^\n]", &M2, &N2, name, cpu2))
+			continue;
+
+		if ((M2 != M) || (N2 != N) || (0 != strcmp(cpu, cpu2)))
+			continue;
+
+		for (int m = SVT_METHOD_GESVD; m <= SVT_METHOD_GRAM; m++) {
+
+			if (0 == strcmp(name, svthresh_method_name[m])) {
+
+				*method = m;
+				found = true;
+			}
+		}
+	}
+
+	fclose(fp);
+
+	return found;
+}
+
+
+/*
+ * Time one method on a test block and check it against cgesvd_.
+ * Returns seconds per block, or -1 if it is not accurate enough.
+ */
+static double svthresh_plan_time(struct svthresh_work_s* ws, enum svthresh_method method, long MN, float lambda, complex float* tmp, const complex float* ref, const complex float* test)
+{
+	svthresh_work_set_method(ws, method);
+
+	memcpy(tmp, test, MN * sizeof(complex float));
+	block_svthresh(ws, lambda, tmp, tmp);
+
+	float err = 0.;
+	float nrm = 0.;
+
+	for (long i = 0; i < MN; i++) {
+
+		err += powf(cabsf(tmp[i] - ref[i]), 2.);
+		nrm += powf(cabsf(ref[i]), 2.);
+	}
+
+	if (sqrtf(err) > SVT_PLAN_TOL * sqrtf(nrm))
+		return -1.;
+
+	long reps = 0;
+	double start = timestamp();
+	double elapsed = 0.;
+
+	do {
+		memcpy(tmp, test, MN * sizeof(complex float));
+		block_svthresh(ws, lambda, tmp, tmp);
+
+		reps++;
+		elapsed = timestamp() - start;
+
+	} while (elapsed < SVT_PLAN_TIME);
+
+	return elapsed / reps;
+}
+
+
+/**
+ * Select the fastest exact SVT algorithm for M x N blocks.
+ *
+ * Candidates are benchmarked on a low rank plus noise test block
+ * and must agree with cgesvd_ to SVT_PLAN_TOL. The choice is read
+ * from and appended to the wisdom file (if not NULL), keyed by
+ * shape and CPU model, so that the benchmark only runs once.
+ */
+enum svthresh_method svthresh_plan(long M, long N, const char* wisdom)
+{
+	long minMN = MIN(M, N);
+
+	if (1 == minMN)
+		return SVT_METHOD_AUTO;
+
+	char cpu[256];
+	cpu_name(sizeof(cpu), cpu);
+
+	enum svthresh_method best = SVT_METHOD_AUTO;
+
+	if ((NULL != wisdom) && wisdom_lookup(wisdom, cpu, M, N, &best)) {
+
+		debug_printf(DP_DEBUG2, "SVT plan %ldx%ld: %s (wisdom)\n", M, N, svthresh_method_name[best]);
+		return best;
+	}
+
+	long MN = M * N;
+
+	if (MN > SVT_PLAN_MAXSIZE) {
+
+		debug_printf(DP_DEBUG2, "SVT plan %ldx%ld: %s (too large to benchmark)\n", M, N, svthresh_method_name[best]);
+		return best;
+	}
+
+	complex float* test = xmalloc(MN * sizeof(complex float));
+	complex float* ref = xmalloc(MN * sizeof(complex float));
+	complex float* tmp = xmalloc(MN * sizeof(complex float));
+
+	// rank minMN / 4 plus noise
+	unsigned int seed = 1;
+	float sigma = 1.E-2;
+
+	for (long i = 0; i < MN; i++)
+		test[i] = sigma * ((rand_r(&seed) / (float)RAND_MAX - 0.5) + 1.i * (rand_r(&seed) / (float)RAND_MAX - 0.5));
+
+	complex float* x = xmalloc(M * sizeof(complex float));
+	complex float* y = xmalloc(N * sizeof(complex float));
+
+	for (long r = 0; r < MAX(1, minMN / 4); r++) {
+
+		for (long i = 0; i < M; i++)
+			x[i] = (rand_r(&seed) / (float)RAND_MAX - 0.5) + 1.i * (rand_r(&seed) / (float)RAND_MAX - 0.5);
+
+		for (long j = 0; j < N; j++)
+			y[j] = (rand_r(&seed) / (float)RAND_MAX - 0.5) / (r + 1.);
+
+		for (long j = 0; j < N; j++)
+			for (long i = 0; i < M; i++)
+				test[i + j * M] += x[i] * y[j];
+	}
+
+	free(x);
+	free(y);
+
+	float lambda = 2. * sigma * (sqrtf(M) + sqrtf(N));
+
+	struct svthresh_work_s* ws = svthresh_work_create(M, N);
+
+	svthresh_work_set_method(ws, SVT_METHOD_GESVD);
+
+	memcpy(ref, test, MN * sizeof(complex float));
+	block_svthresh(ws, lambda, ref, ref);
+
+	double best_time = -1.;
+
+	for (int m = SVT_METHOD_GESVD; m <= SVT_METHOD_GRAM; m++) {
+
+		if ((SVT_METHOD_JACOBI == m) && (minMN > SVT_PLAN_JACOBI_MAXSIZE))
+			continue;
+
+		double t = svthresh_plan_time(ws, m, MN, lambda, tmp, ref, test);
+
+		debug_printf(DP_DEBUG3, "SVT plan %ldx%ld: %s %.2f us\n", M, N, svthresh_method_name[m], t * 1.E6);
+
+		if ((t >= 0.) && ((best_time < 0.) || (t < best_time))) {
+
+			best = m;
+			best_time = t;
+		}
+	}
+
+	svthresh_work_free(ws);
+
+	free(test);
+	free(ref);
+	free(tmp);
+
+	debug_printf(DP_DEBUG2, "SVT plan %ldx%ld: %s\n", M, N, svthresh_method_name[best]);
+
+	if (NULL != wisdom) {
+
+		FILE* fp = fopen(wisdom, "a");
+
+		if (NULL == fp) {
+
+			debug_printf(DP_WARN, "Cannot write wisdom file %s\n", wisdom);
+
+		} else {
+
+			fprintf(fp, "%ld %ld %s %s\n", M, N, svthresh_method_name[best], cpu);
+			fclose(fp);
+		}
+	}
+
+	return best;
+}
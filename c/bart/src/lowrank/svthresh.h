@@ -3,6 +3,8 @@
  * a BSD-style license which can be found in the LICENSE file.
  */ 
 
+#ifndef __SVTHRESH_H
+#define __SVTHRESH_H
 
 #define GWIDTH( M, N, B) ( (sqrtf( M ) + sqrtf( N )) + sqrtf( logf( B * ((M > N) ? N : M )) ))
 
@@ -13,6 +15,8 @@
 
 #include <complex.h>
 
+#include "num/lapack.h"
+
 // Singular value thresholding for matrix
 extern float svthresh(long M, long N, float lambda, complex float* dst, const complex float* src);
 
@@ -23,6 +27,25 @@ extern float svthresh_nomeanu(long M, long N, float lambda, complex float* dst,
 extern float svthresh_nomeanv(long M, long N, float lambda, complex float* dst, const complex float* src);
 
 
+// Singular value thresholding backends for lrthresh
+enum svthresh_backend { SVT_EXACT, SVT_RANDOMIZED, SVT_WARMSTART };
+
+// Randomized singular value thresholding
+struct svthresh_rand_s;
+extern struct svthresh_rand_s* svthresh_rand_create(long M, long N, long maxrank);
+extern void svthresh_rand_free(struct svthresh_rand_s* ws);
+extern long svthresh_rand(struct svthresh_rand_s* ws, long rank, unsigned int seed, float lambda, complex float* dst, const complex float* src);
+
+// Warm-started singular value thresholding from a cached subspace
+extern float svthresh_rand_nucnorm(const struct svthresh_rand_s* ws, long rank, float lambda);
+extern long svthresh_warm_cachesize(const struct svthresh_rand_s* ws);
+extern long svthresh_warm(struct svthresh_rand_s* ws, long rank, long* ncached, complex float* V, unsigned int seed, float lambda, complex float* dst, const complex float* src);
+
+
+// Select the fastest exact SVT algorithm, using and extending a wisdom file
+extern enum svthresh_method svthresh_plan(long M, long N, const char* wisdom);
+
+
 // Singular value analysis (maybe useful to help determining regularization parameter for min nuclear norm)
 extern float nuclearnorm(long M, long N, const complex float* d);
 
@@ -35,3 +58,5 @@ extern float svthresh_blockproc(const void* _data, const long blkdims[DIMS], com
 
 
 extern float nucnorm_blockproc(const void* _data, const long blkdims[DIMS], complex float* dst, const complex float* src);
+
+#endif
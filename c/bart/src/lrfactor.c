@@ -0,0 +1,161 @@
+/* Copyright 2026. The Regents of the University of California.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ *
+ * Authors:
+ * 2026 agent <agent@local>
+ */
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <complex.h>
+#include <math.h>
+#include <assert.h>
+
+#include "num/multind.h"
+#include "num/flpmath.h"
+#include "num/init.h"
+
+#include "lowrank/lrfactor.h"
+
+#include "misc/mri.h"
+#include "misc/mmio.h"
+#include "misc/misc.h"
+#include "misc/debug.h"
+
+
+static const char* usage_str = "[-l level] [-s] [-x dim:start:end] <factors> <output>";
+static const char* help_str =	"Reconstruct a decomposition stored as factors (lrmatrix -O).\n"
+				"\n"
+				"-l level\treconstruct only this level\n"
+				"-s\t\tsum over all levels except the last, as lrmatrix -o\n"
+				"-x dim:start:end\tcrop (can be repeated)\n";
+
+
+static void usage(FILE* fp, const char* name)
+{
+	fprintf(fp, "Usage %s: %s\n", name, usage_str);
+}
+
+static void help(void)
+{
+	printf("\n%s", help_str);
+}
+
+
+int main_lrfactor(int argc, char* argv[])
+{
+	int level = -1;
+	bool sum = false;
+
+	long pos[DIMS] = { [0 ... DIMS - 1] = 0 };
+	long end[DIMS] = { [0 ... DIMS - 1] = -1 };
+
+	int c;
+	while (-1 != (c = getopt(argc, argv, "l:sx:h"))) {
+
+		int dim;
+		long s, e;
+
+		switch (c) {
+
+		case 'l':
+			level = atoi(optarg);
+			break;
+
+		case 's':
+			sum = true;
+			break;
+
+		case 'x':
+			if ((3 != sscanf(optarg, "%d:%ld:%ld", &dim, &s, &e)) || (dim < 0) || (dim >= (int)DIMS) || (s < 0) || (s > e)) {
+
+				usage(stderr, argv[0]);
+				exit(1);
+			}
+
+			pos[dim] = s;
+			end[dim] = e;
+			break;
+
+		case 'h':
+			usage(stdout, argv[0]);
+			help();
+			exit(0);
+
+		default:
+			usage(stderr, argv[0]);
+			exit(1);
+		}
+	}
+
+	if (2 != argc - optind) {
+
+		usage(stderr, argv[0]);
+		exit(1);
+	}
+
+	num_init();
+
+	struct lrfactor_s* f = lrfactor_open(argv[optind + 0]);
+
+	int levels = lrfactor_levels(f);
+
+	long dims[DIMS];
+	lrfactor_dims(f, dims);
+
+	long cdims[DIMS];
+
+	for (unsigned int i = 0; i < DIMS; i++) {
+
+		if (-1 == end[i])
+			end[i] = dims[i] - 1;
+
+		assert(end[i] < dims[i]);
+		cdims[i] = end[i] - pos[i] + 1;
+	}
+
+	assert(level < levels);
+
+	long odims[DIMS];
+	md_copy_dims(DIMS, odims, cdims);
+
+	if ((-1 == level) && !sum)
+		odims[LEVEL_DIM] = levels;
+
+	long ostrs[DIMS];
+	md_calc_strides(DIMS, ostrs, odims, CFL_SIZE);
+
+	complex float* odata = create_cfl(argv[optind + 1], DIMS, odims);
+	md_clear(DIMS, odims, odata, CFL_SIZE);
+
+	complex float* tmp = md_alloc(DIMS, cdims, CFL_SIZE);
+
+	for (int l = 0; l < levels; l++) {
+
+		if ((-1 != level) && (l != level))
+			continue;
+
+		if (sum && (l == levels - 1))
+			continue;
+
+		debug_printf(DP_DEBUG1, "Level %d: rank <= %ld\n", l, lrfactor_rank(f, l));
+
+		lrfactor_level(f, l, pos, cdims, tmp);
+
+		if (sum)
+			md_zaxpy(DIMS, cdims, odata, 1. / sqrt(levels), tmp);
+		else
+			md_copy(DIMS, cdims, odata + ((-1 == level) ? (l * ostrs[LEVEL_DIM] / CFL_SIZE) : 0), tmp, CFL_SIZE);
+	}
+
+	md_free(tmp);
+
+	lrfactor_close(f);
+
+	unmap_cfl(DIMS, odims, odata);
+	exit(0);
+}
+
@@ -21,14 +21,18 @@
 #include "num/flpmath.h"
 #include "num/init.h"
 #include "num/ops.h"
+#include "num/mpi.h"
 
 #include "linops/linop.h"
 
 #include "iter/iter.h"
+#include "iter/vec.h"
 #include "iter/lsqr.h"
 #include "iter/thresh.h"
 
 #include "lowrank/lrthresh.h"
+#include "lowrank/lrdecom.h"
+#include "lowrank/lrfactor.h"
 #include "linops/sum.h"
 #include "linops/sampling.h"
 #include "iter/prox.h"
@@ -62,6 +66,128 @@ static void sum_xupdate_free( const void* data )
 
 
 
+/*
+ * Scan in place, stopping at the first non-zero imaginary part,
+ * so that the check needs no copy of the (possibly out-of-core) data.
+ */
+static bool is_real(long N, const complex float* x)
+{
+	for (long i = 0; i < N; i++)
+		if (0. != cimagf(x[i]))
+			return false;
+
+	return true;
+}
+
+
+/*
+ * Objective for the convergence monitor: the sum of the nuclear
+ * norms of all levels, as computed by the last thresholding.
+ */
+static float lrmatrix_nucnorm(const void* data, const float* x)
+{
+	UNUSED(x);
+
+	float nucnorm[MAX_LEV];
+	int levels = lrthresh_get_nucnorm((const struct operator_p_s*)data, nucnorm);
+
+	float sum = 0.;
+
+	for (int l = 0; l < levels; l++) {
+
+		debug_printf(DP_DEBUG3, "Level %d nuclear norm: %e\n", l, nucnorm[l]);
+		sum += nucnorm[l];
+	}
+
+	return sum;
+}
+
+
+
+/*
+ * Run ADMM for the decomposition (or completion) of idata
+ * into the levels of odata, with odims[LEVEL_DIM] levels.
+ */
+static void lrmatrix_admm(const struct iter_admm_conf* conf, const long odims[DIMS], const complex float* idata, bool completion, const struct operator_p_s* lr_prox, bool use_gpu, bool fold, complex float* odata)
+{
+	long idims[DIMS];
+	md_select_dims(DIMS, ~LEVEL_FLAG, idims, odims);
+
+	// Get pattern
+	complex float* pattern = NULL;
+
+	if (completion) {
+
+		pattern = md_alloc(DIMS, idims, CFL_SIZE);
+		estimate_pattern(DIMS, idims, TIME_DIM, pattern, idata);
+	}
+
+	if (fold) {
+
+		struct lrdecom_conf dconf = lrdecom_defaults;
+		dconf.maxiter = conf->maxiter;
+		dconf.rho = conf->rho;
+		dconf.hogwild = conf->hogwild;
+		dconf.check_every = conf->check_every;
+		dconf.tol = conf->tol;
+		dconf.scratch = conf->scratch;
+
+		lrdecom(&dconf, odims, odata, idata, pattern, lr_prox);
+
+		if (NULL != pattern)
+			md_free(pattern);
+
+		return;
+	}
+
+	const struct linop_s* sum_op = sum_create( odims, use_gpu );
+
+	if (completion) {
+
+		const struct linop_s* sampling_op = sampling_create(idims, idims, pattern);
+		const struct linop_s* tmp_op = linop_chain(sum_op, sampling_op);
+		linop_free(sampling_op);
+		linop_free(sum_op);
+		sum_op = tmp_op;
+	}
+
+	// out-of-core: A^H y and the temporary of the prox are levels x image
+	const struct vec_iter_s* vops = (NULL != conf->scratch) ? scratch_vecops(conf->scratch) : NULL;
+	const struct operator_p_s* sum_prox = prox_lineq_create2( sum_op, idata, vops );
+
+	// put into iter2 format
+	unsigned int num_funs = 2;
+	const struct linop_s* eye_op = linop_identity_create(DIMS, odims);
+	const struct linop_s* ops[2] = { eye_op, eye_op };
+	const struct operator_p_s* prox_ops[2] = { sum_prox, lr_prox };
+	long size = 2 * md_calc_size(DIMS, odims);
+
+	struct s_data* s_data = xmalloc(sizeof(struct s_data));
+	s_data->size = size / 2;
+
+	const struct operator_p_s* sum_xupdate_op = operator_p_create( DIMS, odims, DIMS, odims, (void*)s_data, sum_xupdate, sum_xupdate_free );
+
+	iter2_admm( (void*)conf,
+		    NULL,
+		    num_funs,
+		    prox_ops,
+		    ops,
+		    sum_xupdate_op,
+		    size, (float*) odata, NULL,
+		    NULL,
+		    (void*)lr_prox, (conf->check_every > 0) ? lrmatrix_nucnorm : NULL );
+
+	operator_p_free( sum_xupdate_op );
+	operator_p_free( sum_prox );
+	linop_free( eye_op );
+	linop_free( sum_op );
+
+	if (NULL != pattern)
+		md_free(pattern);
+}
+
+
+
 static void usage(const char* name, FILE* fd)
 {
 	fprintf(fd, "Usage: %s [-options] <input> <output>\n", name);
@@ -81,6 +207,29 @@ static void help(void)
                 "-s\t\tperform low rank + sparse matrix completion.\n"
                 "-l block-size\tperform locally low rank soft thresholding with specified block size.\n"
                 "-o <output2>\tsummed over all non-noise scales to create a denoised output.\n"
+                "-r\t\tuse randomized SVD for levels with large blocks.\n"
+                "-w\t\twarm start SVD of large blocks from the previous iteration.\n"
+                "-S dir\t\tout-of-core: keep iteration state in scratch files in dir.\n"
+                "-W window\tonline: sliding window of frames, emitting each new frame.\n"
+                "\t\tFrames are read as they arrive from a pipe or growing file.\n"
+                "-t dim\t\tonline: time dimension (default: last non-singleton).\n"
+                "-I iter\t\tonline: warm-started iterations per new frame.\n"
+                "-Z K[:R]\tskip levels which are zero for K iterations, re-check every R (5K).\n"
+                "-C S[:seed]\taverage over S block shifts per iteration (cycle spinning).\n"
+                "-c\t\tinput is a sparse list of observed entries (.mtx or binary).\n"
+                "-O\t\tstore the decomposition as per-block factors in <output>\n"
+                "\t\tinstead of dense levels (implies -a).\n"
+                "-P wisdom\tbenchmark SVT algorithms for each level, stored in wisdom.\n"
+                "-R\t\treal-valued SVT (default if the input is real).\n"
+                "-a\t\tsolve with the sum constraint folded into ADMM (less memory).\n"
+                "-K iter\t\tcheck convergence every iter iterations.\n"
+                "-e tol\t\tstop if, at a check, the relative change of the objective since the\n"
+                "\t\tlast check or the relative residual of the last iteration is below tol.\n"
+                "\n"
+                "Under mpirun, -a with fixed blocks (-n) is the default, unless -C, -c\n"
+                "or -W is given; these exchange all levels in each iteration. A warning\n"
+                "is printed when this changes the method; the result then matches a serial\n"
+                "run with -a -n, not one without.\n"
 		"\n");
 }
 
@@ -89,6 +238,12 @@ int main_lrmatrix(int argc, char* argv[])
 {
 	double start_time = timestamp();
 
+	// distributed mode if started by mpirun
+	mpi_init(&argc, &argv);
+
+	int rank = mpi_get_rank();
+	int nprocs = mpi_get_size();
+
 	bool use_gpu = false;
 
 	int maxiter = 100;
@@ -108,9 +263,26 @@ int main_lrmatrix(int argc, char* argv[])
 	_Bool fast = true;
 	long initblk = 1;
 	int remove_mean = 0;
+	_Bool randsvd = false;
+	_Bool warmsvd = false;
+	const char* scratch = NULL;
+	long window = 0;
+	int tdim = -1;
+	int online_iter = 10;
+	unsigned int check_every = 0;
+	_Bool fold = false;
+	_Bool real = false;
+	const char* wisdom = NULL;
+	_Bool factored = false;
+	_Bool sparse = false;
+	int prune_after = 0;
+	int recheck = 0;
+	float tol = 0.;
+	int nshifts = 0;
+	unsigned int seed = 1;
 
 	int c;
-	while (-1 != (c = getopt(argc, argv, "uvNi:p:m:j:k:o:hnl:sf:gHFd"))) {
+	while (-1 != (c = getopt(argc, argv, "uvNi:p:m:j:k:o:hnl:sf:gHFdrwS:W:t:I:K:e:aRP:OcZ:C:"))) {
 		switch(c) {
 
                 case 'd':
@@ -178,6 +350,77 @@ int main_lrmatrix(int argc, char* argv[])
 			use_gpu = true;
 			break;
 
+		case 'r':
+			randsvd = true;
+			break;
+
+		case 'w':
+			warmsvd = true;
+			break;
+
+		case 'S':
+			scratch = strdup(optarg);
+			break;
+
+		case 'W':
+			window = atol(optarg);
+			break;
+
+		case 't':
+			tdim = atoi(optarg);
+			break;
+
+		case 'I':
+			online_iter = atoi(optarg);
+			break;
+
+		case 'K':
+			check_every = atoi(optarg);
+			break;
+
+		case 'e':
+			tol = atof(optarg);
+			break;
+
+		case 'a':
+			fold = true;
+			break;
+
+		case 'R':
+			real = true;
+			break;
+
+		case 'P':
+			wisdom = strdup(optarg);
+			break;
+
+		case 'O':
+			factored = true;
+			break;
+
+		case 'c':
+			sparse = true;
+			break;
+
+		case 'Z':
+			if (1 > sscanf(optarg, "%d:%d", &prune_after, &recheck)) {
+
+				usage(argv[0], stderr);
+				exit(1);
+			}
+
+			if (0 >= recheck)
+				recheck = 5 * prune_after;
+			break;
+
+		case 'C':
+			if ((1 > sscanf(optarg, "%d:%u", &nshifts, &seed)) || (nshifts < 1)) {
+
+				usage(argv[0], stderr);
+				exit(1);
+			}
+			break;
+
 		case 'h':
 			usage(argv[0], stdout);
 			help();
@@ -195,66 +438,173 @@ int main_lrmatrix(int argc, char* argv[])
 		exit(1);
 	}
 
+	const char* factors = factored ? argv[optind + 1] : NULL;
+
 
 	long idims[DIMS];
 	long odims[DIMS];
 
 	// Load input
-	complex float* idata = load_cfl(argv[optind + 0], DIMS, idims);
+	complex float* idata = NULL;
+	int ifd = -1;			// online: frames are read as they arrive
+
+	long nnz = 0;
+	long* sp_idx = NULL;
+	complex float* sp_val = NULL;
+
+	if (sparse) {
+
+		if (decom || (window > 0))
+			error("Sparse input is only supported for completion.\n");
+
+		nnz = load_spm(argv[optind + 0], DIMS, idims, &sp_idx, &sp_val);
+
+		debug_printf(DP_INFO, "Sparse input: %ld of %ld entries observed\n", nnz, md_calc_size(DIMS, idims));
+
+	} else if ((window > 0) && (1 == nprocs)) {
+
+		ifd = open_cfl_stream(argv[optind + 0], DIMS, idims);
+
+	} else {
+
+		idata = load_cfl(argv[optind + 0], DIMS, idims);
+	}
+
+	// Sliding window along the time dimension
+	long wdims[DIMS];
+	md_copy_dims(DIMS, wdims, idims);
+
+	if ((NULL != factors) && (window > 0))
+		error("Factored output is not supported in online mode.\n");
+
+	if ((NULL != factors) && (0 < nshifts))
+		error("Factored output is not supported with cycle spinning.\n");
+
+	// the folded ADMM returns the output of the thresholding,
+	// whose blocks are exactly low rank
+	if ((NULL != factors) && !fold) {
+
+		debug_printf(DP_INFO, "Factored output: using the folded ADMM (-a)\n");
+		fold = true;
+	}
+
+	// distributed: fixed blocks and the folded ADMM by default, so that
+	// only the sum over the levels is exchanged instead of all levels
+	if ((nprocs > 1) && !sparse && (0 == nshifts) && (0 == window) && (randshift || !fold)) {
+
+		if (0 == rank)
+			debug_printf(DP_WARN, "Warning: under mpirun, using fixed blocks and the folded ADMM (-a -n).\n"
+				"The result differs from a serial run without -a -n; pass -a -n to match it.\n");
+
+		randshift = false;
+		fold = true;
+	}
+
+	if (window > 0) {
+
+		if (-1 == tdim)
+			for (unsigned int i = 0; i < DIMS; i++)
+				if (1 != idims[i])
+					tdim = i;
+
+		assert((0 <= tdim) && (tdim < (int)DIMS) && (LEVEL_DIM != tdim));
+
+		window = MIN(window, idims[tdim]);
+		wdims[tdim] = window;
+
+		debug_printf(DP_INFO, "Online: window of %ld frames along dimension %d\n", window, tdim);
+
+		// frames can only be streamed if each is contiguous
+		if ((-1 != ifd) && (1 != md_calc_size(DIMS - tdim - 1, idims + tdim + 1))) {
+
+			debug_printf(DP_INFO, "Online: frames are not contiguous, reading the whole input\n");
+
+			close_cfl_stream(ifd);
+			ifd = -1;
+
+			idata = load_cfl(argv[optind + 0], DIMS, idims);
+		}
+	}
 
 	// Get levels and block dimensions
 	long blkdims[MAX_LEV][DIMS];
 	long levels;
 	if (llr)
-		levels = llr_blkdims(blkdims, flags, idims, llrblk);
+		levels = llr_blkdims(blkdims, flags, wdims, llrblk);
 	else if (ls)
-		levels = ls_blkdims(blkdims, idims);
+		levels = ls_blkdims(blkdims, wdims);
 	else
-		levels = multilr_blkdims(blkdims, flags, idims, blkskip, initblk);
+		levels = multilr_blkdims(blkdims, flags, wdims, blkskip, initblk);
 
 	if (noise)
-		add_lrnoiseblk( &levels, blkdims, idims );
+		add_lrnoiseblk( &levels, blkdims, wdims );
 	debug_printf(DP_INFO, "Number of levels: %ld\n", levels);
 
 	// Get outdims
 	md_copy_dims(DIMS, odims, idims);
 	odims[LEVEL_DIM] = levels;
-	complex float* odata = create_cfl(argv[optind + 1], DIMS, odims);
+	bool dense = (0 == rank) && (NULL == factors);
+	complex float* odata = dense ? create_cfl(argv[optind + 1], DIMS, odims) : anon_cfl(NULL, DIMS, odims);
 	md_clear( DIMS, odims, odata, sizeof(complex float) );
 
-	// Get pattern
-	complex float* pattern = NULL;
-
-        if (!decom) {
-                pattern = md_alloc(DIMS, idims, CFL_SIZE);
-                estimate_pattern(DIMS, idims, TIME_DIM, pattern, idata);
-        }
+	long wodims[DIMS];
+	md_copy_dims(DIMS, wodims, wdims);
+	wodims[LEVEL_DIM] = levels;
 
 	// Initialize algorithm
-	void* iconf;
-
 	struct iter_admm_conf mmconf;
 	memcpy(&mmconf, &iter_admm_defaults, sizeof(struct iter_admm_conf));
 	mmconf.maxiter = maxiter;
 	mmconf.rho = rho;
 	mmconf.hogwild = hogwild;
 	mmconf.fast = fast;
-	
-	iconf = &mmconf;
+	mmconf.scratch = scratch;
+	mmconf.check_every = check_every;
+	mmconf.tol = tol;
 
 
 	// Initialize operators
 
-	const struct linop_s* sum_op = sum_create( odims, use_gpu );
-	const struct linop_s* sampling_op = NULL;
-        if (!decom) {
-                sampling_op = sampling_create(idims, idims, pattern);
-                sum_op = linop_chain(sum_op, sampling_op);
-                linop_free(sampling_op);
-        }
-	
-	const struct operator_p_s* sum_prox = prox_lineq_create( sum_op, idata );
-	const struct operator_p_s* lr_prox = lrthresh_create(odims, randshift, mflags, (const long (*)[])blkdims, 1., noise, remove_mean, use_gpu);
+	const struct operator_p_s* lr_prox = lrthresh_create(wodims, randshift, mflags, (const long (*)[])blkdims, 1., noise, remove_mean, use_gpu);
+
+	if (randsvd)
+		lrthresh_set_backend(lr_prox, SVT_RANDOMIZED);
+
+	if (warmsvd)
+		lrthresh_set_backend(lr_prox, SVT_WARMSTART);
+
+	if (NULL != wisdom)
+		lrthresh_plan(lr_prox, wisdom);
+
+	if (prune_after > 0)
+		lrthresh_set_prune(lr_prox, prune_after, recheck);
+
+	if (0 < nshifts)
+		lrthresh_set_cyclespin(lr_prox, nshifts, seed);
+
+	if (NULL != scratch)
+		lrthresh_set_scratch(lr_prox, scratch);
+
+	if (nprocs > 1) {
+
+		// with fixed blocks only the level sums are exchanged
+		bool partial = fold && !sparse && !randshift && (0 == nshifts) && (0 == window);
+
+		debug_printf(DP_INFO, "Distributed: process %d of %d\n", rank, nprocs);
+		lrthresh_set_partition(lr_prox, rank, nprocs, partial);
+	}
+
+	if (!real && sparse)
+		real = is_real(nnz, sp_val);
+
+	if (!real && (NULL != idata))
+		real = is_real(md_calc_size(DIMS, idims), idata);
+
+	if (real) {
+
+		debug_printf(DP_INFO, "Real-valued SVT\n");
+		lrthresh_set_real(lr_prox, true);
+	}
 
         assert(use_gpu == false);
 
@@ -263,32 +613,198 @@ int main_lrmatrix(int argc, char* argv[])
 	if (use_gpu)
 		debug_printf(DP_INFO, "GPU reconstruction\n");
 
-	// put into iter2 format
-	unsigned int num_funs = 2;
-	const struct linop_s* eye_op = linop_identity_create(DIMS, odims);
-	const struct linop_s* ops[2] = { eye_op, eye_op };
-	const struct operator_p_s* prox_ops[2] = { sum_prox, lr_prox };
-	long size = 2 * md_calc_size(DIMS, odims);
-	struct s_data s_data = { size / 2 };
 
-	const struct operator_p_s* sum_xupdate_op = operator_p_create( DIMS, odims, DIMS, odims, (void*) &s_data, sum_xupdate, sum_xupdate_free );
+	// do recon
 
+	if (0 == window) {
 
-	// do recon
-	
-	iter2_admm( iconf,
-		    NULL,
-		    num_funs,
-		    prox_ops,
-		    ops,
-		    sum_xupdate_op,
-		    size, (float*) odata, NULL,
-		    NULL, NULL, NULL );
-	
+		if (sparse) {
+
+			struct lrdecom_conf dconf = lrdecom_defaults;
+			dconf.maxiter = mmconf.maxiter;
+			dconf.rho = mmconf.rho;
+			dconf.hogwild = mmconf.hogwild;
+			dconf.check_every = mmconf.check_every;
+			dconf.tol = mmconf.tol;
+			dconf.scratch = mmconf.scratch;
+
+			lrdecom_sparse(&dconf, odims, odata, nnz, sp_idx, sp_val, lr_prox);
+
+		} else {
+
+			lrmatrix_admm(&mmconf, odims, idata, !decom, lr_prox, use_gpu, fold, odata);
+		}
+
+		if (NULL != factors)
+			lrthresh_gather_ranks(lr_prox);
+
+		if ((NULL != factors) && (0 == rank)) {
+
+			struct lrthresh_geom_s geom[MAX_LEV];
+			lrthresh_get_geom(lr_prox, geom);
+
+			lrfactor_write(factors, odims, geom, 0., odata);
+		}
+
+	} else {
+
+		long T = idims[tdim];
+
+		long istrs[DIMS];
+		long ostrs[DIMS];
+		long wstrs[DIMS];
+		long wostrs[DIMS];
+
+		md_calc_strides(DIMS, istrs, idims, CFL_SIZE);
+		md_calc_strides(DIMS, ostrs, odims, CFL_SIZE);
+		md_calc_strides(DIMS, wstrs, wdims, CFL_SIZE);
+		md_calc_strides(DIMS, wostrs, wodims, CFL_SIZE);
+
+		// distance of consecutive frames in elements
+		long istep = istrs[tdim] / CFL_SIZE;
+		long ostep = ostrs[tdim] / CFL_SIZE;
+		long wstep = wstrs[tdim] / CFL_SIZE;
+		long wostep = wostrs[tdim] / CFL_SIZE;
+
+		long fdims[DIMS];		// one frame of all levels
+		md_select_dims(DIMS, ~MD_BIT(tdim), fdims, wodims);
 
+		long idims1[DIMS];		// one frame of the input
+		md_select_dims(DIMS, ~MD_BIT(tdim), idims1, wdims);
+
+		long fsize = md_calc_size(DIMS, idims1);
+
+		complex float* wdata = md_alloc(DIMS, wdims, CFL_SIZE);
+		complex float* wodata = md_alloc(DIMS, wodims, CFL_SIZE);
+		complex float* resid = md_alloc(DIMS, idims1, CFL_SIZE);
+
+		long rstrs[DIMS];		// broadcast over levels
+		md_calc_strides(DIMS, rstrs, idims1, CFL_SIZE);
+		rstrs[LEVEL_DIM] = 0;
+
+		// real-valued SVT for streams as long as all frames are real
+		bool detect = (-1 != ifd) && !real;
+
+		// first window from scratch
+		if (-1 != ifd) {
+
+			if (!read_cfl_stream(ifd, window * fsize, wdata))
+				error("Input stream ended in the first window.\n");
+
+		} else {
+
+			md_copy_block(DIMS, (long[DIMS]){ 0 }, wdims, wdata, idims, idata, CFL_SIZE);
+		}
+
+		if (detect) {
+
+			if (is_real(md_calc_size(DIMS, wdims), wdata)) {
+
+				debug_printf(DP_INFO, "Real-valued SVT\n");
+				lrthresh_set_real(lr_prox, true);
+			} else {
+
+				detect = false;
+			}
+		}
+
+		md_clear(DIMS, wodims, wodata, CFL_SIZE);
+
+		lrmatrix_admm(&mmconf, wodims, wdata, !decom, lr_prox, use_gpu, fold, wodata);
+
+		md_copy_block(DIMS, (long[DIMS]){ 0 }, odims, odata, wodims, wodata, CFL_SIZE);
+
+		// later windows advance by one frame and are warm-started,
+		// continuing with the penalty reached by the hogwild schedule
+		if (mmconf.hogwild) {
+
+			for (int i = 0, k = 0, K = 1; i < maxiter; i++) {
+
+				if (++k == K) {
+
+					k = 0;
+					K *= 2;
+					mmconf.rho *= 2.;
+				}
+			}
+
+			mmconf.hogwild = false;
+		}
+
+		mmconf.maxiter = online_iter;
+		mmconf.do_warmstart = true;
+
+		double tic = timestamp();
+
+		long t = window;
+
+		for (; t < T; t++) {
+
+			complex float* last = wdata + (window - 1) * wstep;
+			complex float* olast = wodata + (window - 1) * wostep;
+
+			// drop oldest frame
+			for (long k = 0; k < window - 1; k++) {
+
+				md_copy2(DIMS, idims1, wstrs, wdata + k * wstep, wstrs, wdata + (k + 1) * wstep, CFL_SIZE);
+				md_copy2(DIMS, fdims, wostrs, wodata + k * wostep, wostrs, wodata + (k + 1) * wostep, CFL_SIZE);
+			}
+
+			// append new frame, its components start from those of the previous
+			// one, corrected by the least-norm update to match the new data
+			if (-1 != ifd) {
+
+				if (!read_cfl_stream(ifd, fsize, last)) {
+
+					debug_printf(DP_INFO, "Online: input stream ended after %ld of %ld frames\n", t, T);
+					break;
+				}
+
+				if (detect) {
+
+					if (!is_real(fsize, last)) {
+
+						debug_printf(DP_INFO, "Online: complex-valued frame, switching to complex SVT\n");
+						lrthresh_set_real(lr_prox, false);
+						detect = false;
+					}
+				}
+
+			} else {
+
+				md_copy2(DIMS, idims1, wstrs, last, istrs, idata + t * istep, CFL_SIZE);
+			}
+
+			if (window > 1)
+				md_copy2(DIMS, fdims, wostrs, olast, wostrs, olast - wostep, CFL_SIZE);
+
+			md_copy2(DIMS, idims1, rstrs, resid, wstrs, last, CFL_SIZE);
+			md_zaxpy2(DIMS, fdims, rstrs, resid, -1. / sqrtf(levels), wostrs, olast);
+			md_zaxpy2(DIMS, fdims, wostrs, olast, 1. / sqrtf(levels), rstrs, resid);
+
+			lrmatrix_admm(&mmconf, wodims, wdata, !decom, lr_prox, use_gpu, fold, wodata);
+
+			// emit newest frame
+			md_copy2(DIMS, fdims, ostrs, odata + t * ostep, wostrs, olast, CFL_SIZE);
+		}
+
+		double toc = timestamp();
+
+		if (t > window)
+			debug_printf(DP_INFO, "Online: %.2f frames/s\n", (double)(t - window) / (toc - tic));
+
+		md_free(wdata);
+		md_free(wodata);
+		md_free(resid);
+	}
+
+
+
+	if (prune_after > 0)
+		lrthresh_report(lr_prox);
 
 	// Sum
-	if (sum_str)
+	if (sum_str && (0 == rank))
 	{
 		complex float* sdata = create_cfl(sum_str, DIMS, idims);
 		long istrs[DIMS];
@@ -306,15 +822,31 @@ int main_lrmatrix(int argc, char* argv[])
 
 
 	// Clean up
-	unmap_cfl(DIMS, idims, idata);
+	if (sparse) {
+
+		free(sp_idx);
+		free(sp_val);
+
+	} else if (-1 != ifd) {
+
+		close_cfl_stream(ifd);
+
+	} else {
+
+		unmap_cfl(DIMS, idims, idata);
+	}
+
 	unmap_cfl(DIMS, odims, odata);
-	linop_free( sum_op );
-	operator_p_free( sum_prox );
 	operator_p_free( lr_prox );
 
+	if (NULL != scratch)
+		free((void*)scratch);
+
 
 	double end_time = timestamp();
 	debug_printf(DP_INFO, "Total Time: %f\n", end_time - start_time);
+
+	mpi_finalize();
 	exit(0);
 }
 
@@ -20,6 +20,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <sys/mman.h>
 #include <time.h>
 
@@ -42,6 +43,22 @@ double timestamp(void)
 }
 
 
+// peak resident set size in bytes
+long peak_memory(void)
+{
+	struct rusage ru;
+
+	if (0 != getrusage(RUSAGE_SELF, &ru))
+		return -1;
+
+#ifdef __APPLE__
+	return ru.ru_maxrss;
+#else
+	return ru.ru_maxrss * 1024L;
+#endif
+}
+
+
 void dump_cfl(const char* name, int D, const long dimensions[D], const complex float* src)
 {
 	complex float* out = create_cfl(name, D, dimensions);
@@ -21,6 +21,7 @@ extern "C" {
 
 extern void dump_cfl(const char* name, int D, const long dimensions[__VLA(D)], const _Complex float* x);
 extern double timestamp(void);
+extern long peak_memory(void);
 
 extern int debug_level;
 extern _Bool debug_logging;
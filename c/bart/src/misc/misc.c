@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <getopt.h>
+#include <setjmp.h>
 
 #include "misc/debug.h"
 #include "misc.h"
@@ -30,6 +31,18 @@ void* xmalloc(size_t s)
 
 
 
+/*
+ * Library entry points can set env (from setjmp) so that error()
+ * returns there instead of aborting the host process. This only
+ * applies to errors on the calling thread. NULL restores abort().
+ */
+static __thread jmp_buf* error_env = NULL;
+
+void error_catch(jmp_buf* env)
+{
+	error_env = env;
+}
+
 
 void error(const char* fmt, ...)
 {
@@ -39,6 +52,10 @@ void error(const char* fmt, ...)
 		debug_printf(DP_ERROR, "Error: ");
 	debug_vprintf(DP_ERROR, fmt, ap);
 	va_end(ap);
+
+	if (NULL != error_env)
+		longjmp(*error_env, 1);
+
 	abort();
 }
 
@@ -4,6 +4,7 @@
  */
 
 #include <stdlib.h>
+#include <setjmp.h>
 
 #ifndef M_PI
 #define M_PI 3.1415926535897932384626433832795
@@ -33,6 +34,7 @@ extern void* xmalloc(size_t s);
 
 extern int parse_cfl(_Complex float res[1], const char* str);
 extern void error(const char* str, ...);
+extern void error_catch(jmp_buf* env);
 
 extern void print_dims(int D, const long dims[__VLA(D)]);
 extern void debug_print_dims(int dblevel, int D, const long dims[__VLA(D)]);
@@ -19,6 +19,8 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <assert.h>
 
 #include <sys/mman.h>
 
@@ -175,6 +177,142 @@ complex float* load_zcoo(const char* name, unsigned int D, long dimensions[D])
 }
 
 
+/**
+ * Load a sparse list of entries as linear indices into an array
+ * of size dims and their values. Two formats are understood:
+ *
+ * .mtx: text in MatrixMarket coordinate format (real, integer or
+ *	complex, 1-based row and column indices of a matrix)
+ *
+ * otherwise: a 4096 byte text header
+ *
+ *	Type: sparse
+ *	Dimensions: D
+ *	dims[0]
+ *	...
+ *	Entries: nnz
+ *
+ * followed by nnz records of a 64 bit linear index and a complex float.
+ *
+ * Entries are read in a streaming fashion, so memory is O(nnz).
+ */
+long load_spm(const char* name, unsigned int D, long dims[D], long** idx, complex float** val)
+{
+	FILE* fp;
+	if (NULL == (fp = fopen(name, "r")))
+		io_error("Loading sparse file %s", name);
+
+	for (unsigned int i = 0; i < D; i++)
+		dims[i] = 1;
+
+	long nnz;
+	const char *p = strrchr(name, '.');
+
+	if ((NULL != p) && (p != name) && (0 == strcmp(p, ".mtx"))) {
+
+		char line[1024];
+		char field[32];
+
+		if (   (NULL == fgets(line, sizeof(line), fp))
+		    || (1 != sscanf(line, "%%%%MatrixMarket matrix coordinate %31s general", field)))
+			io_error("Loading sparse file %s", name);
+
+		bool cplx = (0 == strcmp(field, "complex"));
+
+		if (!cplx && (0 != strcmp(field, "real")) && (0 != strcmp(field, "integer")))
+			io_error("Loading sparse file %s", name);
+
+		do {
+			if (NULL == fgets(line, sizeof(line), fp))
+				io_error("Loading sparse file %s", name);
+
+		} while ('%' == line[0]);
+
+		assert(D >= 2);
+
+		if (3 != sscanf(line, "%ld %ld %ld", &dims[0], &dims[1], &nnz))
+			io_error("Loading sparse file %s", name);
+
+		*idx = xmalloc(nnz * sizeof(long));
+		*val = xmalloc(nnz * sizeof(complex float));
+
+		for (long k = 0; k < nnz; k++) {
+
+			long i, j;
+			float re, im = 0.;
+
+			if (   (NULL == fgets(line, sizeof(line), fp))
+			    || ((cplx ? 4 : 3) != sscanf(line, "%ld %ld %f %f", &i, &j, &re, &im))
+			    || (i < 1) || (i > dims[0]) || (j < 1) || (j > dims[1]))
+				io_error("Loading sparse file %s", name);
+
+			(*idx)[k] = (i - 1) + (j - 1) * dims[0];
+			(*val)[k] = re + 1.i * im;
+		}
+
+	} else {
+
+		char header[4096];
+
+		if (4096 != fread(header, 1, 4096, fp))
+			io_error("Loading sparse file %s", name);
+
+		header[4095] = '\0';
+
+		int pos = 0;
+		int delta = 0;
+		int dim;
+
+		if (   (1 != sscanf(header, "Type: sparse\nDimensions: %d\n%n", &dim, &delta))
+		    || (0 == delta) || (dim > (int)D))
+			io_error("Loading sparse file %s", name);
+
+		pos += delta;
+
+		for (int i = 0; i < dim; i++) {
+
+			if (1 != sscanf(header + pos, "%ld\n%n", &dims[i], &delta))
+				io_error("Loading sparse file %s", name);
+
+			pos += delta;
+		}
+
+		if (1 != sscanf(header + pos, "Entries: %ld\n", &nnz))
+			io_error("Loading sparse file %s", name);
+
+		long size = md_calc_size(D, dims);
+
+		*idx = xmalloc(nnz * sizeof(long));
+		*val = xmalloc(nnz * sizeof(complex float));
+
+		struct { int64_t idx; complex float val; } buf[4096];
+
+		for (long k = 0; k < nnz; ) {
+
+			long n = MIN(nnz - k, 4096);
+
+			if (n != (long)fread(buf, sizeof(buf[0]), n, fp))
+				io_error("Loading sparse file %s", name);
+
+			for (long i = 0; i < n; i++, k++) {
+
+				if ((buf[i].idx < 0) || (buf[i].idx >= size))
+					io_error("Loading sparse file %s", name);
+
+				(*idx)[k] = buf[i].idx;
+				(*val)[k] = buf[i].val;
+			}
+		}
+	}
+
+	if (0 != fclose(fp))
+		io_error("Loading sparse file %s", name);
+
+	return nnz;
+}
+
+
+
 static complex float* load_cfl_internal(const char* name, unsigned int D, long dimensions[D], bool priv)
 {
 	const char *p = strrchr(name, '.');
@@ -248,6 +386,123 @@ complex float* shared_cfl(unsigned int D, const long dims[D], const char* name)
 }
 
 
+/**
+ * Map a temporary file in directory dir, which is removed when
+ * unmapped. Used to keep large arrays out of core.
+ */
+complex float* scratch_cfl(const char* dir, unsigned int D, const long dims[D])
+{
+	int fd;
+	void* addr;
+	long T = md_calc_size(D, dims) * sizeof(complex float);
+
+	char name[strlen(dir) + 32];
+	snprintf(name, sizeof(name), "%s/bart-scratch-XXXXXX", dir);
+
+	if (-1 == (fd = mkstemp(name)))
+		io_error("Creating scratch file %s", name);
+
+	if (-1 == unlink(name))
+		io_error("Creating scratch file %s", name);
+
+	if (-1 == (ftruncate(fd, T)))
+		io_error("Creating scratch file %s", name);
+
+	if (MAP_FAILED == (addr = mmap(NULL, T, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)))
+		io_error("Creating scratch file %s", name);
+
+	if (-1 == close(fd))
+		io_error("Creating scratch file %s", name);
+
+	return (complex float*)addr;
+}
+
+
+/**
+ * Open the data of a cfl file for sequential reading with
+ * read_cfl_stream. The data file may be a named pipe or a
+ * file which is still being written.
+ */
+int open_cfl_stream(const char* name, unsigned int D, long dimensions[D])
+{
+	char name_bdy[1024];
+	if (1024 <= snprintf(name_bdy, 1024, "%s.cfl", name))
+		io_error("Opening cfl stream %s", name);
+
+	char name_hdr[1024];
+	if (1024 <= snprintf(name_hdr, 1024, "%s.hdr", name))
+		io_error("Opening cfl stream %s", name);
+
+	int ofd;
+	if (-1 == (ofd = open(name_hdr, O_RDONLY)))
+		io_error("Opening cfl stream %s", name);
+
+	if (-1 == read_cfl_header(ofd, D, dimensions))
+		io_error("Opening cfl stream %s", name);
+
+	if (-1 == close(ofd))
+		io_error("Opening cfl stream %s", name);
+
+	int fd;
+	if (-1 == (fd = open(name_bdy, O_RDONLY)))
+		io_error("Opening cfl stream %s", name);
+
+	return fd;
+}
+
+
+/**
+ * Read the next N elements of a cfl stream. At the end of a
+ * regular file this waits until the file grows. Returns false
+ * if the writer closed the pipe or the file did not grow for
+ * CFL_STREAM_TIMEOUT seconds.
+ */
+#define CFL_STREAM_TIMEOUT 60
+
+bool read_cfl_stream(int fd, long N, complex float* x)
+{
+	char* ptr = (char*)x;
+	long T = N * (long)sizeof(complex float);
+	int waited = 0;	// in units of 100 ms
+
+	while (T > 0) {
+
+		ssize_t r = read(fd, ptr, T);
+
+		if (-1 == r)
+			io_error("Reading cfl stream");
+
+		if (r > 0) {
+
+			ptr += r;
+			T -= r;
+			waited = 0;
+			continue;
+		}
+
+		struct stat st;
+
+		if (-1 == fstat(fd, &st))
+			io_error("Reading cfl stream");
+
+		if (!S_ISREG(st.st_mode) || (waited >= 10 * CFL_STREAM_TIMEOUT))
+			return false;
+
+		usleep(100000);
+		waited++;
+	}
+
+	return true;
+}
+
+
+void close_cfl_stream(int fd)
+{
+	if (-1 == close(fd))
+		io_error("Closing cfl stream");
+}
+
+
 complex float* anon_cfl(const char* name, unsigned int D, const long dims[D])
 {
 	UNUSED(name);
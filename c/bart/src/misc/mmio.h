@@ -20,6 +20,7 @@ extern _Complex float* shared_cfl(unsigned int D, const long dims[__VLA(D)], con
 extern _Complex float* private_cfl(unsigned int D, const long dims[__VLA(D)], const char* name);
 extern void unmap_cfl(unsigned int D, const long dims[__VLA(D)], const _Complex float* x);
 
+extern _Complex float* scratch_cfl(const char* dir, unsigned int D, const long dims[__VLA(D)]);
 extern _Complex float* anon_cfl(const char* name, unsigned int D, const long dims[__VLA(D)]);
 extern _Complex float* create_cfl(const char* name, unsigned int D, const long dimensions[__VLA(D)]);
 extern _Complex float* load_cfl(const char* name, unsigned int D, long dimensions[__VLA(D)]);
@@ -30,6 +31,12 @@ extern float* load_coo(const char* name, unsigned int D, long dimensions[__VLA(D
 extern _Complex float* create_zcoo(const char* name, unsigned int D, const long dimensions[__VLA(D)]);
 extern _Complex float* load_zcoo(const char* name, unsigned int D, long dimensions[__VLA(D)]);
 
+extern int open_cfl_stream(const char* name, unsigned int D, long dimensions[__VLA(D)]);
+extern _Bool read_cfl_stream(int fd, long N, _Complex float* x);
+extern void close_cfl_stream(int fd);
+
+extern long load_spm(const char* name, unsigned int D, long dimensions[__VLA(D)], long** idx, _Complex float** val);
+
 #ifdef __cplusplus
 }
 #endif
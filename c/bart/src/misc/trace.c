@@ -0,0 +1,267 @@
+/* Copyright 2026. The Regents of the University of California.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ *
+ * Authors:
+ * 2026 agent <agent@local>
+ *
+ * Lightweight tracing. If the environment variable BART_TRACE names
+ * a file, timed sections (TRACE_BEGIN/TRACE_END, which nest per
+ * thread) and counters are recorded in a fixed buffer, which is
+ * appended to the file whenever it is full and at exit, as CSV if
+ * the name ends in .csv and as Chrome trace JSON (for chrome://tracing)
+ * otherwise. Flushes are recorded as "trace flush" events. When
+ * disabled, each trace point costs one test of a global flag.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "misc/misc.h"
+#include "misc/debug.h"
+
+#include "trace.h"
+
+#define TRACE_NAME 48
+#define TRACE_DEPTH 64
+#define TRACE_BUFFER 65536	// events kept in memory
+
+
+bool trace_on = false;
+
+static bool trace_initialized = false;
+static const char* trace_file = NULL;
+
+struct trace_event_s {
+
+	char name[TRACE_NAME];
+	char ph;		// 'X' complete event, 'C' counter
+	int tid;
+	int depth;
+	double ts;		// microseconds
+	double dur;
+	double flops;
+	double bytes;
+	double value;
+};
+
+static struct trace_event_s* events = NULL;
+static long nevents = 0;
+
+static FILE* trace_fp = NULL;
+static bool trace_csv = false;
+static long nwritten = 0;
+
+static __thread double stack[TRACE_DEPTH];
+static __thread int depth = 0;
+
+static double t0 = 0.;
+
+
+
+double trace_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1.E6 + ts.tv_nsec * 1.E-3 - t0;
+}
+
+
+static int trace_tid(void)
+{
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+
+static void json_name(FILE* fp, const char* name)
+{
+	fputc('"', fp);
+
+	for (const char* p = name; '\0' != *p; p++)
+		if (('"' != *p) && ('\\' != *p))
+			fputc(*p, fp);
+
+	fputc('"', fp);
+}
+
+
+/*
+ * Append the buffered events to the trace file (opened on first use).
+ */
+static void trace_flush(void)
+{
+	if (NULL == trace_fp) {
+
+		trace_fp = fopen(trace_file, "w");
+
+		if (NULL == trace_fp) {
+
+			debug_printf(DP_WARN, "Could not write trace %s\n", trace_file);
+			trace_on = false;
+			nevents = 0;
+			return;
+		}
+
+		const char* p = strrchr(trace_file, '.');
+
+		trace_csv = (NULL != p) && (0 == strcmp(p, ".csv"));
+
+		if (trace_csv)
+			fprintf(trace_fp, "name,phase,thread,depth,start_us,duration_us,flops,bytes,value\n");
+		else
+			fprintf(trace_fp, "{\"traceEvents\":[\n");
+	}
+
+	for (long i = 0; i < nevents; i++) {
+
+		const struct trace_event_s* ev = &events[i];
+
+		if (trace_csv) {
+
+			fprintf(trace_fp, "%s,%c,%d,%d,%.3f,%.3f,%.0f,%.0f,%g\n", ev->name, ev->ph, ev->tid, ev->depth,
+					ev->ts, ev->dur, ev->flops, ev->bytes, ev->value);
+			continue;
+		}
+
+		fprintf(trace_fp, "%s{\"name\":", (0 < nwritten + i) ? ",\n" : "");
+		json_name(trace_fp, ev->name);
+
+		if ('X' == ev->ph)
+			fprintf(trace_fp, ",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"flops\":%.0f,\"bytes\":%.0f}}",
+					ev->tid, ev->ts, ev->dur, ev->flops, ev->bytes);
+		else
+			fprintf(trace_fp, ",\"ph\":\"C\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%g}}",
+					ev->tid, ev->ts, ev->value);
+	}
+
+	nwritten += nevents;
+	nevents = 0;
+}
+
+
+static void trace_add(const struct trace_event_s* ev)
+{
+	#pragma omp critical (trace)
+	{
+		if (nevents == TRACE_BUFFER) {
+
+			double start = trace_time();
+
+			trace_flush();
+
+			// the stall is visible in the trace
+			if (trace_on)
+				events[nevents++] = (struct trace_event_s){ .name = "trace flush", .ph = 'X',
+						.tid = trace_tid(), .ts = start, .dur = trace_time() - start };
+		}
+
+		if (trace_on)
+			events[nevents++] = *ev;
+	}
+}
+
+
+static void trace_write(void)
+{
+	if (NULL == events)
+		return;
+
+	trace_flush();
+
+	if (NULL != trace_fp) {
+
+		if (!trace_csv)
+			fprintf(trace_fp, "\n]}\n");
+
+		fclose(trace_fp);
+		trace_fp = NULL;
+
+		debug_printf(DP_DEBUG1, "Trace: %ld events written to %s\n", nwritten, trace_file);
+	}
+
+	trace_on = false;
+
+	free(events);
+	events = NULL;
+}
+
+
+void trace_init(void)
+{
+	if (trace_initialized)
+		return;
+
+	trace_initialized = true;
+	trace_file = getenv("BART_TRACE");
+
+	if ((NULL == trace_file) || ('\0' == trace_file[0]))
+		return;
+
+	events = xmalloc(TRACE_BUFFER * sizeof(struct trace_event_s));
+
+	t0 = trace_time();
+	trace_on = true;
+
+	atexit(trace_write);
+}
+
+
+void trace_begin(void)
+{
+	if (depth < TRACE_DEPTH)
+		stack[depth] = trace_time();
+
+	depth++;
+}
+
+
+void trace_end(double flops, double bytes, const char* fmt, ...)
+{
+	double now = trace_time();
+
+	depth--;
+
+	if ((depth < 0) || (depth >= TRACE_DEPTH)) {
+
+		depth = MAX(depth, 0);
+		return;
+	}
+
+	struct trace_event_s ev = { .ph = 'X', .tid = trace_tid(), .depth = depth,
+			.ts = stack[depth], .dur = now - stack[depth], .flops = flops, .bytes = bytes };
+
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(ev.name, TRACE_NAME, fmt, ap);
+	va_end(ap);
+
+	trace_add(&ev);
+}
+
+
+void trace_counter(double value, const char* fmt, ...)
+{
+	struct trace_event_s ev = { .ph = 'C', .tid = trace_tid(), .depth = depth,
+			.ts = trace_time(), .value = value };
+
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(ev.name, TRACE_NAME, fmt, ap);
+	va_end(ap);
+
+	trace_add(&ev);
+}
@@ -0,0 +1,32 @@
+/* Copyright 2026. The Regents of the University of California.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ */
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern bool trace_on;
+
+extern void trace_init(void);
+extern void trace_begin(void);
+extern void trace_end(double flops, double bytes, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+extern void trace_counter(double value, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+extern double trace_time(void);
+
+// nested timers, only evaluated if tracing is enabled (BART_TRACE)
+#define TRACE_BEGIN() do { if (trace_on) trace_begin(); } while (0)
+#define TRACE_END(...) do { if (trace_on) trace_end(__VA_ARGS__); } while (0)
+#define TRACE_COUNTER(...) do { if (trace_on) trace_counter(__VA_ARGS__); } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __TRACE_H
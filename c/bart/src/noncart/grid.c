@@ -10,6 +10,8 @@
 #include <complex.h>
 #include <assert.h>
 #include <string.h>
+#include <stdbool.h>
+#include <stdlib.h>
 
 
 #include "num/multind.h"
@@ -138,6 +140,221 @@ static float intlookup(int n, const float table[n + 1], float x)
 
 
 
+/*
+ * Samples are sorted into bins of grid cells. Each bin is spread
+ * into (or interpolated from) a private subgrid which covers the bin
+ * and the kernel width around it, with the channels stored contiguously.
+ * Bins with the same parity in all dimensions do not overlap, so their
+ * subgrids are added to the grid in 2^d passes without atomic operations
+ * and the result does not depend on the number of threads.
+ */
+
+struct grid_bins_s {
+
+	int ext;		// kernel extent: ceil(width)
+	int bsize[3];		// size of a bin
+	int nbins[3];		// number of bins
+	int ssize[3];		// size of a subgrid
+	long cells;		// cells of a subgrid
+
+	long* offs;		// start of each bin in the sorted samples
+	long* order;		// samples sorted by bin
+	float (*pos)[3];	// grid positions of the samples
+	int (*start)[3];	// first grid point of the kernel windows
+};
+
+
+static void grid_bins_init(struct grid_bins_s* bins, float os, float width, const complex float* traj, const long grid_dims[3], long samples)
+{
+	bins->ext = (int)ceilf(width);
+
+	int active = 0;
+
+	for (int j = 0; j < 3; j++)
+		if (grid_dims[j] > 1)
+			active++;
+
+	// a subgrid should fit into the L1/L2 cache for a few channels
+	int bsize = (3 == active) ? 8 : ((2 == active) ? 32 : 512);
+
+	// bins of the same parity must not overlap
+	bsize = MAX(bsize, 2 * bins->ext + 2);
+
+	long nb = 1;
+	bins->cells = 1;
+
+	for (int j = 0; j < 3; j++) {
+
+		bins->bsize[j] = (grid_dims[j] > 1) ? bsize : 1;
+		bins->nbins[j] = (grid_dims[j] + bins->bsize[j] - 1) / bins->bsize[j];
+		bins->ssize[j] = (grid_dims[j] > 1) ? (bsize + 2 * bins->ext) : 1;
+
+		nb *= bins->nbins[j];
+		bins->cells *= bins->ssize[j];
+	}
+
+	bins->pos = xmalloc(samples * sizeof(float[3]));
+	bins->start = xmalloc(samples * sizeof(int[3]));
+	bins->order = xmalloc(samples * sizeof(long));
+	bins->offs = xmalloc((nb + 1) * sizeof(long));
+
+	long* bin = xmalloc(samples * sizeof(long));
+
+#pragma omp parallel for
+	for (long i = 0; i < samples; i++) {
+
+		long b = 0;
+
+		for (int j = 2; j >= 0; j--) {
+
+			float pos = os * crealf(traj[i * 3 + j]);
+
+			pos += (grid_dims[j] > 1) ? ((float)grid_dims[j] / 2.) : 0.;
+
+			bins->pos[i][j] = pos;
+
+			// bin by the integer window so that rounding
+			// cannot move a window outside of the subgrid
+
+			int st = (int)ceil(pos - width);
+
+			bins->start[i][j] = st;
+
+			int k = (st + bins->ext) / bins->bsize[j];
+
+			if (st + bins->ext < 0)
+				k = 0;
+
+			b = b * bins->nbins[j] + MIN(k, bins->nbins[j] - 1);
+		}
+
+		bin[i] = b;
+	}
+
+	// stable counting sort, so that the order within a bin is fixed
+
+	for (long b = 0; b <= nb; b++)
+		bins->offs[b] = 0;
+
+	for (long i = 0; i < samples; i++)
+		bins->offs[bin[i] + 1]++;
+
+	for (long b = 0; b < nb; b++)
+		bins->offs[b + 1] += bins->offs[b];
+
+	long* next = xmalloc(nb * sizeof(long));
+
+	for (long b = 0; b < nb; b++)
+		next[b] = bins->offs[b];
+
+	for (long i = 0; i < samples; i++)
+		bins->order[next[bin[i]]++] = i;
+
+	free(next);
+	free(bin);
+}
+
+
+static void grid_bins_free(struct grid_bins_s* bins)
+{
+	free(bins->pos);
+	free(bins->start);
+	free(bins->order);
+	free(bins->offs);
+}
+
+
+static long grid_bins_total(const struct grid_bins_s* bins)
+{
+	return (long)bins->nbins[0] * bins->nbins[1] * bins->nbins[2];
+}
+
+
+// position of a bin and the origin of its subgrid
+static void grid_bin_origin(const struct grid_bins_s* bins, long b, int idx[3], int org[3])
+{
+	for (int j = 0; j < 3; j++) {
+
+		idx[j] = b % bins->nbins[j];
+		b /= bins->nbins[j];
+
+		org[j] = idx[j] * bins->bsize[j] - ((bins->ssize[j] > 1) ? bins->ext : 0);
+	}
+}
+
+
+/*
+ * Kernel window of a sample in subgrid coordinates and the weights
+ * for each dimension, computed once instead of for each grid point.
+ * Returns false if the window is outside of the grid.
+ */
+static bool grid_window(const long dims[3], const int org[3], const float pos[3], const int start[3], float width, int kb_size, const float kb_table[kb_size + 1], int W, int st[3], int len[3], float wgh[3][W])
+{
+	for (int j = 0; j < 3; j++) {
+
+		int s = MAX(start[j], 0);
+		int e = MIN((int)floor(pos[j] + width), MIN(start[j] + W - 1, dims[j] - 1));
+
+		if (s > e)
+			return false;
+
+		for (int k = s; k <= e; k++)
+			wgh[j][k - s] = intlookup(kb_size, kb_table, fabs((float)k - pos[j]) / width);
+
+		st[j] = s - org[j];
+		len[j] = e - s + 1;
+	}
+
+	return true;
+}
+
+
+// add (or copy to) the part of the subgrid which is inside the grid
+static void grid_subgrid_merge(const struct grid_bins_s* bins, const int org[3], long C, const long dims[3], complex float* grid, const complex float* sub)
+{
+	int st[3];
+	int en[3];
+
+	for (int j = 0; j < 3; j++) {
+
+		st[j] = MAX(org[j], 0);
+		en[j] = MIN(org[j] + bins->ssize[j], dims[j]);
+	}
+
+	long cstr = dims[0] * dims[1] * dims[2];
+
+	for (long c = 0; c < C; c++)
+		for (int z = st[2]; z < en[2]; z++)
+			for (int y = st[1]; y < en[1]; y++)
+				for (int x = st[0]; x < en[0]; x++)
+					grid[c * cstr + (z * dims[1] + y) * dims[0] + x]
+						+= sub[(((z - org[2]) * bins->ssize[1] + (y - org[1])) * bins->ssize[0] + (x - org[0])) * C + c];
+}
+
+
+static void grid_subgrid_load(const struct grid_bins_s* bins, const int org[3], long C, const long dims[3], complex float* sub, const complex float* grid)
+{
+	int st[3];
+	int en[3];
+
+	for (int j = 0; j < 3; j++) {
+
+		st[j] = MAX(org[j], 0);
+		en[j] = MIN(org[j] + bins->ssize[j], dims[j]);
+	}
+
+	long cstr = dims[0] * dims[1] * dims[2];
+
+	for (long c = 0; c < C; c++)
+		for (int z = st[2]; z < en[2]; z++)
+			for (int y = st[1]; y < en[1]; y++)
+				for (int x = st[0]; x < en[0]; x++)
+					sub[(((z - org[2]) * bins->ssize[1] + (y - org[1])) * bins->ssize[0] + (x - org[0])) * C + c]
+						= grid[c * cstr + (z * dims[1] + y) * dims[0] + x];
+}
+
+
+
 void gridH(float os, float width, double beta, const complex float* traj, const long ksp_dims[4], complex float* dst, const long grid_dims[4], const complex float* grid)
 {
 	long C = ksp_dims[3];
@@ -154,27 +371,70 @@ void gridH(float os, float width, double beta, const complex float* traj, const
 	assert(1 == ksp_dims[0]);
 	long samples = ksp_dims[1] * ksp_dims[2];
 
-#pragma omp parallel for
-	for(int i = 0; i < samples; i++) {
+	struct grid_bins_s bins;
+	grid_bins_init(&bins, os, width, traj, grid_dims, samples);
+
+	int W = 2 * bins.ext + 1;
+	long nb = grid_bins_total(&bins);
+
+#pragma omp parallel
+	{
+		complex float* sub = xmalloc(bins.cells * C * sizeof(complex float));
+
+#pragma omp for schedule(dynamic)
+		for (long b = 0; b < nb; b++) {
+
+			if (bins.offs[b] == bins.offs[b + 1])
+				continue;
+
+			int idx[3];
+			int org[3];
+			grid_bin_origin(&bins, b, idx, org);
+			grid_subgrid_load(&bins, org, C, grid_dims, sub, grid);
+
+			for (long k = bins.offs[b]; k < bins.offs[b + 1]; k++) {
+
+				long i = bins.order[k];
+
+				int st[3];
+				int len[3];
+				float wgh[3][W];
+
+				if (!grid_window(grid_dims, org, bins.pos[i], bins.start[i], width, kb_size, kb_table, W, st, len, wgh))
+					continue;
 
-		float pos[3];
-		pos[0] = os * (creal(traj[i * 3 + 0]));
-		pos[1] = os * (creal(traj[i * 3 + 1]));
-		pos[2] = os * (creal(traj[i * 3 + 2]));
+				complex float val[C];
 
-		pos[0] += (grid_dims[0] > 1) ? ((float)grid_dims[0] / 2.) : 0.;
-		pos[1] += (grid_dims[1] > 1) ? ((float)grid_dims[1] / 2.) : 0.;
-		pos[2] += (grid_dims[2] > 1) ? ((float)grid_dims[2] / 2.) : 0.;
+				for (long c = 0; c < C; c++)
+					val[c] = 0.;
 
-		complex float val[C];
-		for (int j = 0; j < C; j++)
-			val[j] = 0.0;
-		
-		grid_pointH(C, grid_dims, pos, val, grid, width, kb_size, kb_table);
+				for (int w = 0; w < len[2]; w++) {
 
-		for (int j = 0; j < C; j++)
-			dst[j * samples + i] += val[j];
+					float dw = wgh[2][w];
+
+				for (int v = 0; v < len[1]; v++) {
+
+					float dv = dw * wgh[1][v];
+					const complex float* row = sub + ((st[2] + w) * bins.ssize[1] + st[1] + v) * bins.ssize[0] * C;
+
+				for (int u = 0; u < len[0]; u++) {
+
+					float du = dv * wgh[0][u];
+					const complex float* g = row + (st[0] + u) * C;
+
+				for (long c = 0; c < C; c++)
+					val[c] += g[c] * du;
+				}}}
+
+				for (long c = 0; c < C; c++)
+					dst[c * samples + i] += val[c];
+			}
+		}
+
+		free(sub);
 	}
+
+	grid_bins_free(&bins);
 }
 
 
@@ -195,26 +455,77 @@ void grid(float os, float width, double beta, const complex float* traj, const l
 	assert(1 == ksp_dims[0]);
 	long samples = ksp_dims[1] * ksp_dims[2];
 
+	struct grid_bins_s bins;
+	grid_bins_init(&bins, os, width, traj, grid_dims, samples);
+
+	int W = 2 * bins.ext + 1;
+	long nb = grid_bins_total(&bins);
+
 	// grid
-#pragma omp parallel for
-	for(int i = 0; i < samples; i++) {
+#pragma omp parallel
+	{
+		complex float* sub = xmalloc(bins.cells * C * sizeof(complex float));
+
+		for (int color = 0; color < 8; color++) {
+
+#pragma omp for schedule(dynamic)
+			for (long b = 0; b < nb; b++) {
+
+				if (bins.offs[b] == bins.offs[b + 1])
+					continue;
+
+				int idx[3];
+				int org[3];
+				grid_bin_origin(&bins, b, idx, org);
+
+				if (color != (idx[0] & 1) + 2 * (idx[1] & 1) + 4 * (idx[2] & 1))
+					continue;
+
+				memset(sub, 0, bins.cells * C * sizeof(complex float));
+
+				for (long k = bins.offs[b]; k < bins.offs[b + 1]; k++) {
 
-		float pos[3];
-		pos[0] = os * (creal(traj[i * 3 + 0]));
-		pos[1] = os * (creal(traj[i * 3 + 1]));
-		pos[2] = os * (creal(traj[i * 3 + 2]));
+					long i = bins.order[k];
 
-		pos[0] += (grid_dims[0] > 1) ? ((float) grid_dims[0] / 2.) : 0.;
-		pos[1] += (grid_dims[1] > 1) ? ((float) grid_dims[1] / 2.) : 0.;
-		pos[2] += (grid_dims[2] > 1) ? ((float) grid_dims[2] / 2.) : 0.;
+					int st[3];
+					int len[3];
+					float wgh[3][W];
 
-		complex float val[C];
-		
-		for (int j = 0; j < C; j++)
-			val[j] = src[j * samples + i];
+					if (!grid_window(grid_dims, org, bins.pos[i], bins.start[i], width, kb_size, kb_table, W, st, len, wgh))
+						continue;
 
-		grid_point(C, grid_dims, pos, grid, val, width, kb_size, kb_table);
+					complex float val[C];
+
+					for (long c = 0; c < C; c++)
+						val[c] = src[c * samples + i];
+
+					for (int w = 0; w < len[2]; w++) {
+
+						float dw = wgh[2][w];
+
+					for (int v = 0; v < len[1]; v++) {
+
+						float dv = dw * wgh[1][v];
+						complex float* row = sub + ((st[2] + w) * bins.ssize[1] + st[1] + v) * bins.ssize[0] * C;
+
+					for (int u = 0; u < len[0]; u++) {
+
+						float du = dv * wgh[0][u];
+						complex float* g = row + (st[0] + u) * C;
+
+					for (long c = 0; c < C; c++)
+						g[c] += val[c] * du;
+					}}}
+				}
+
+				grid_subgrid_merge(&bins, org, C, grid_dims, grid, sub);
+			}
+		}
+
+		free(sub);
 	}
+
+	grid_bins_free(&bins);
 }
 
 
@@ -368,14 +679,10 @@ void grid_pointH(unsigned int ch, const long dims[3], const float pos[3], comple
 		float du = dv * intlookup(kb_size, kb_table, frac / width);
 		int indu = (indv + u);
 
-	for (unsigned int c = 0; c < ch; c++) {
-
-		// we are allowed to update real and imaginary part independently which works atomically
-		#pragma omp atomic
-		__real(val[c]) += __real(src[indu + c * dims[0] * dims[1] * dims[2]]) * du;
-		#pragma omp atomic
-		__imag(val[c]) += __imag(src[indu + c * dims[0] * dims[1] * dims[2]]) * du;
-	}}}}
+	// val belongs to the caller, so no atomics are needed
+	for (unsigned int c = 0; c < ch; c++)
+		val[c] += src[indu + c * dims[0] * dims[1] * dims[2]] * du;
+	}}}
 }
 
 
@@ -8,6 +8,8 @@
  */
 
 #include <complex.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <assert.h>
 
 #include "num/multind.h"
@@ -153,3 +155,251 @@ void basorati_matrixH(unsigned int N, const long dimk[N], const long dim[N], con
 
 
 
+/**
+ * Index tables for the fused block gather/scatter. The image is
+ * circularly extended to zdim and circularly shifted by shift
+ * (as md_circ_ext followed by md_circ_shift). For each dimension,
+ * gidx[i][z] is the offset (in elements) of the source element at
+ * position z of the shifted image, and sidx[i][z] the offset of the
+ * destination element it is copied back to, or -1 if it is a copy
+ * of another element (as md_circ_shift back followed by md_resize).
+ *
+ * gidx[i] and sidx[i] must have room for zdim[i] elements.
+ */
+void basorati_circ_index(unsigned int N, long* gidx[N], long* sidx[N], const long zdim[N], const long shift[N], const long dim[N], const long str[N])
+{
+	for (unsigned int i = 0; i < N; i++) {
+
+		assert(zdim[i] >= dim[i]);
+		assert(zdim[i] <= 2 * dim[i]);
+
+		long s = shift[i] % zdim[i];
+
+		for (long z = 0; z < zdim[i]; z++) {
+
+			long y = (z - s + zdim[i]) % zdim[i];
+
+			gidx[i][z] = (y % dim[i]) * (long)(str[i] / CFL_SIZE);
+			sidx[i][z] = (y < dim[i]) ? gidx[i][z] : -1;
+		}
+	}
+}
+
+
+
+/*
+ * Geometry of one block: offset of the first element and, for every
+ * non-singleton block dimension, its index table. Returns false if
+ * the block has no valid elements.
+ */
+static bool basorati_block_geom(unsigned int N, long* nd, long dims[N], const long* tab[N], long* base, const long dimk[N], const long pos[N], const long* idx[N])
+{
+	*nd = 0;
+	*base = 0;
+
+	for (unsigned int i = 0; i < N; i++) {
+
+		const long* t = idx[i] + pos[i] * dimk[i];
+
+		if (1 == dimk[i]) {
+
+			if (t[0] < 0)
+				return false;
+
+			*base += t[0];
+			continue;
+		}
+
+		dims[*nd] = dimk[i];
+		tab[*nd] = t;
+		(*nd)++;
+	}
+
+	return true;
+}
+
+
+static inline double gather_row(long n, const long* tab, const complex float* iptr, complex float* optr)
+{
+	double nsq = 0.;
+
+	for (long e = 0; e < n; e++) {
+
+		complex float v = iptr[tab[e]];
+
+		nsq += crealf(v) * crealf(v) + cimagf(v) * cimagf(v);
+
+		if (NULL != optr)
+			optr[e] = v;
+	}
+
+	return nsq;
+}
+
+
+static inline void scatter_row(long n, const long* tab, complex float* optr, const complex float* iptr)
+{
+	for (long e = 0; e < n; e++)
+		if (tab[e] >= 0)
+			optr[tab[e]] = (NULL == iptr) ? 0. : iptr[e];
+}
+
+
+static const long zero_idx[1] = { 0 };
+
+
+/**
+ * Fused gather of block pos (in units of blocks) of a circularly
+ * extended and shifted image into a column-major block matrix
+ * (same layout as a column of basorati_matrix). Index tables are
+ * from basorati_circ_index. If optr is NULL, only the norm is computed.
+ *
+ * Returns the squared Frobenius norm of the block.
+ */
+float basorati_gather_block(unsigned int N, const long dimk[N], const long pos[N], const long* gidx[N], complex float* optr, const complex float* iptr)
+{
+	long nd;
+	long dims[N + 1];
+	const long* tab[N + 1];
+	long base;
+
+	if (!basorati_block_geom(N, &nd, dims, tab, &base, dimk, pos, gidx))
+		assert(0);
+
+	if (0 == nd) {
+
+		dims[0] = 1;
+		tab[0] = zero_idx;
+		nd = 1;
+	}
+
+	long n = dims[0];
+	double nsq = 0.;
+
+	// specialized for the common 2D and 3D block shapes
+	switch (nd) {
+
+	case 1:
+		nsq = gather_row(n, tab[0], iptr + base, optr);
+		break;
+
+	case 2:
+		for (long e1 = 0; e1 < dims[1]; e1++)
+			nsq += gather_row(n, tab[0], iptr + base + tab[1][e1], (NULL == optr) ? NULL : (optr + e1 * n));
+		break;
+
+	case 3:
+		for (long e2 = 0; e2 < dims[2]; e2++)
+			for (long e1 = 0; e1 < dims[1]; e1++)
+				nsq += gather_row(n, tab[0], iptr + base + tab[2][e2] + tab[1][e1], (NULL == optr) ? NULL : (optr + (e2 * dims[1] + e1) * n));
+		break;
+
+	default: ;
+
+		long p[nd];
+		long rows = 1;
+
+		for (long k = 0; k < nd; k++) {
+
+			p[k] = 0;
+
+			if (k > 0)
+				rows *= dims[k];
+		}
+
+		for (long r = 0; r < rows; r++) {
+
+			long off = base;
+
+			for (long k = 1; k < nd; k++)
+				off += tab[k][p[k]];
+
+			nsq += gather_row(n, tab[0], iptr + off, (NULL == optr) ? NULL : (optr + r * n));
+
+			for (long k = 1; (k < nd) && (++p[k] == dims[k]); k++)
+				p[k] = 0;
+		}
+	}
+
+	return nsq;
+}
+
+
+
+/**
+ * Fused scatter of a column-major block matrix back into block pos of
+ * the image, undoing the shift and dropping elements which are copies
+ * from the circular extension. Index tables are from basorati_circ_index.
+ * If iptr is NULL, the block is cleared.
+ */
+void basorati_scatter_block(unsigned int N, const long dimk[N], const long pos[N], const long* sidx[N], complex float* optr, const complex float* iptr)
+{
+	long nd;
+	long dims[N + 1];
+	const long* tab[N + 1];
+	long base;
+
+	if (!basorati_block_geom(N, &nd, dims, tab, &base, dimk, pos, sidx))
+		return;
+
+	if (0 == nd) {
+
+		dims[0] = 1;
+		tab[0] = zero_idx;
+		nd = 1;
+	}
+
+	long n = dims[0];
+
+	switch (nd) {
+
+	case 1:
+		scatter_row(n, tab[0], optr + base, iptr);
+		break;
+
+	case 2:
+		for (long e1 = 0; e1 < dims[1]; e1++)
+			if (tab[1][e1] >= 0)
+				scatter_row(n, tab[0], optr + base + tab[1][e1], (NULL == iptr) ? NULL : (iptr + e1 * n));
+		break;
+
+	case 3:
+		for (long e2 = 0; e2 < dims[2]; e2++)
+			for (long e1 = 0; e1 < dims[1]; e1++)
+				if ((tab[2][e2] >= 0) && (tab[1][e1] >= 0))
+					scatter_row(n, tab[0], optr + base + tab[2][e2] + tab[1][e1], (NULL == iptr) ? NULL : (iptr + (e2 * dims[1] + e1) * n));
+		break;
+
+	default: ;
+
+		long p[nd];
+		long rows = 1;
+
+		for (long k = 0; k < nd; k++) {
+
+			p[k] = 0;
+
+			if (k > 0)
+				rows *= dims[k];
+		}
+
+		for (long r = 0; r < rows; r++) {
+
+			long off = base;
+			bool valid = true;
+
+			for (long k = 1; k < nd; k++) {
+
+				valid = valid && (tab[k][p[k]] >= 0);
+				off += tab[k][p[k]];
+			}
+
+			if (valid)
+				scatter_row(n, tab[0], optr + off, (NULL == iptr) ? NULL : (iptr + r * n));
+
+			for (long k = 1; (k < nd) && (++p[k] == dims[k]); k++)
+				p[k] = 0;
+		}
+	}
+}
+
@@ -14,4 +14,8 @@ extern void basorati_dims(unsigned int N, long odim[2], const long dimk[__VLA(N)
 extern void basorati_matrix(unsigned int N, const long dimk[__VLA(N)], const long odim[2], _Complex float* optr, const long dim[__VLA(N)], const long str[__VLA(N)], const _Complex float* iptr);
 extern void basorati_matrixH(unsigned int N, const long dimk[__VLA(N)], const long dim[__VLA(N)], const long str[__VLA(N)], _Complex float* optr, const long odim[2], const _Complex float* iptr);
 
+extern void basorati_circ_index(unsigned int N, long* gidx[__VLA(N)], long* sidx[__VLA(N)], const long zdim[__VLA(N)], const long shift[__VLA(N)], const long dim[__VLA(N)], const long str[__VLA(N)]);
+extern float basorati_gather_block(unsigned int N, const long dimk[__VLA(N)], const long pos[__VLA(N)], const long* gidx[__VLA(N)], _Complex float* optr, const _Complex float* iptr);
+extern void basorati_scatter_block(unsigned int N, const long dimk[__VLA(N)], const long pos[__VLA(N)], const long* sidx[__VLA(N)], _Complex float* optr, const _Complex float* iptr);
+
 #include "misc/cppwrap.h"
@@ -18,6 +18,9 @@
 #include <assert.h>
 #include <complex.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include <fftw3.h>
@@ -28,6 +31,7 @@
 
 #include "misc/misc.h"
 #include "misc/debug.h"
+#include "misc/trace.h"
 
 #include "fft.h"
 #undef fft_plan_s
@@ -193,17 +197,143 @@ void fftshift(unsigned int N, const long dimensions[N], unsigned long flags, com
 
 
 
-struct fft_plan_s {
+/*
+ * FFTW plans are cached and shared. The key is the layout of the
+ * transform, the alignment of the arrays, the direction, the number
+ * of threads, and the planner effort. Plans are executed with the
+ * new-array interface, which is thread-safe, so the (serialized)
+ * planner only runs once per layout. The effort is set with
+ * BART_FFTW_PLANNER=estimate|measure|patient|exhaustive, and wisdom
+ * is loaded from and saved to the file in BART_FFTW_WISDOM.
+ */
+
+#define FFT_CACHE_SIZE 64
+
+struct fft_cache_s {
 
+	struct fft_cache_s* next;
+
+	unsigned int D;
+	long* dims;		// dimensions, ostrides, istrides
+	unsigned long flags;
+	bool backwards;
+	bool inplace;
+	int oalign;
+	int ialign;
+	int nthreads;
+	unsigned int effort;
+
+	int refs;
 	fftwf_plan fftw;
-	
-#ifdef  USE_CUDA
-	struct fft_cuda_plan_s* cuplan;
-#endif
 };
 
+static struct fft_cache_s* fft_cache = NULL;
+static int fft_cache_entries = 0;
+static bool fft_cache_init = false;
+
+static const unsigned int fft_efforts[] = { FFTW_ESTIMATE, FFTW_MEASURE, FFTW_PATIENT, FFTW_EXHAUSTIVE };
+static const char* fft_effort_names[] = { "estimate", "measure", "patient", "exhaustive" };
+
+static enum fft_planner fft_effort = FFT_ESTIMATE;
+static int fft_nthreads = 1;
+static const char* fft_wisdom = NULL;
+static bool fft_wisdom_new = false;
+
+
+static void fft_wisdom_export(void)
+{
+	if (fft_wisdom_new && !fftwf_export_wisdom_to_filename(fft_wisdom))
+		debug_printf(DP_WARN, "Could not save FFTW wisdom to %s\n", fft_wisdom);
+}
+
+
+// must be called in the critical section
+static void fft_cache_setup(void)
+{
+	if (fft_cache_init)
+		return;
+
+	fft_cache_init = true;
+
+	const char* str = getenv("BART_FFTW_PLANNER");
+
+	if (NULL != str) {
+
+		unsigned int n = sizeof(fft_effort_names) / sizeof(fft_effort_names[0]);
+		unsigned int i = 0;
+
+		while ((i < n) && (0 != strcmp(str, fft_effort_names[i])))
+			i++;
+
+		if (i < n)
+			fft_effort = i;
+		else
+			debug_printf(DP_WARN, "Unknown FFTW planner effort: %s\n", str);
+	}
+
+	fft_wisdom = getenv("BART_FFTW_WISDOM");
+
+	if (NULL != fft_wisdom) {
+
+		if (fftwf_import_wisdom_from_filename(fft_wisdom))
+			debug_printf(DP_DEBUG1, "Loaded FFTW wisdom from %s\n", fft_wisdom);
+
+		atexit(fft_wisdom_export);
+	}
+}
+
+
+void fft_set_planner(enum fft_planner effort)
+{
+	#pragma omp critical
+	{
+		fft_cache_setup();
+		fft_effort = effort;
+	}
+}
+
+
+static bool fft_cache_match(const struct fft_cache_s* e, unsigned int D, const long dimensions[D], unsigned long flags, const long ostrides[D], const long istrides[D], bool backwards, bool inplace, int oalign, int ialign)
+{
+	return (e->D == D) && (e->flags == flags) && (e->backwards == backwards)
+		&& (e->inplace == inplace) && (e->oalign == oalign) && (e->ialign == ialign)
+		&& (e->nthreads == fft_nthreads) && (e->effort == fft_efforts[fft_effort])
+		&& (0 == memcmp(e->dims, dimensions, D * sizeof(long)))
+		&& (0 == memcmp(e->dims + D, ostrides, D * sizeof(long)))
+		&& (0 == memcmp(e->dims + 2 * D, istrides, D * sizeof(long)));
+}
+
+
+// byte offsets of the first and last element addressed with strs
+static void fft_extent(unsigned int D, const long dimensions[D], const long strs[D], long* lo, long* hi)
+{
+	for (unsigned int i = 0; i < D; i++) {
+
+		long off = (dimensions[i] - 1) * strs[i];
+
+		if (off < 0)
+			*lo += off;
+		else
+			*hi += off;
+	}
+}
+
+
+// scratch array with the same alignment as ptr
+static complex float* fft_scratch(long lo, long hi, const void* ptr, void** mem)
+{
+	long pad = 64 * ((-lo + 63) / 64);
+
+	*mem = fftwf_malloc(pad + 64 + hi - lo + CFL_SIZE);
 
+	if (NULL == *mem)
+		error("Could not allocate memory for FFTW planning.\n");
 
+	return (complex float*)((char*)*mem + pad + (uintptr_t)ptr % 64);
+}
+
+
+// must be called in the critical section
 static fftwf_plan fft_fftwf_plan(unsigned int D, const long dimensions[D], unsigned long flags, const long ostrides[D], complex float* dst, const long istrides[D], const complex float* src, bool backwards)
 {
 	unsigned int N = D;
@@ -233,15 +363,184 @@ static fftwf_plan fft_fftwf_plan(unsigned int D, const long dimensions[D], unsig
 		}
 	}
 
-	fftwf_plan fftwf;
+	unsigned int effort = fft_efforts[fft_effort];
 
-	#pragma omp critical
-	fftwf = fftwf_plan_guru_dft(k, dims, l, hmdims, (complex float*)src, dst, backwards ? 1 : (-1), FFTW_ESTIMATE);
+	// all efforts except estimate overwrite the arrays when planning
+
+	void* imem = NULL;
+	void* omem = NULL;
+
+	if (FFTW_ESTIMATE != effort) {
+
+		long lo = 0;
+		long hi = 0;
+
+		fft_extent(D, dimensions, ostrides, &lo, &hi);
+
+		if (dst == src) {
+
+			fft_extent(D, dimensions, istrides, &lo, &hi);
+			dst = fft_scratch(lo, hi, dst, &omem);
+			src = dst;
+
+		} else {
+
+			dst = fft_scratch(lo, hi, dst, &omem);
+
+			lo = hi = 0;
+			fft_extent(D, dimensions, istrides, &lo, &hi);
+			src = fft_scratch(lo, hi, src, &imem);
+		}
+
+		fft_wisdom_new = true;
+	}
+
+	TRACE_BEGIN();
+
+	fftwf_plan fftwf = fftwf_plan_guru_dft(k, dims, l, hmdims, (complex float*)src, dst, backwards ? 1 : (-1), effort);
+
+	TRACE_END(0., 0., "fft plan");
+
+	if (NULL != omem)
+		fftwf_free(omem);
+
+	if (NULL != imem)
+		fftwf_free(imem);
 
 	return fftwf;
 }
 
 
+static void fft_cache_destroy(struct fft_cache_s* e)
+{
+	fftwf_destroy_plan(e->fftw);
+	free(e->dims);
+	free(e);
+
+	fft_cache_entries--;
+}
+
+
+/**
+ * Return a cached plan for this layout, planning it if necessary.
+ * The plan is referenced until fft_cache_put is called.
+ */
+static struct fft_cache_s* fft_cache_get(unsigned int D, const long dimensions[D], unsigned long flags, const long ostrides[D], complex float* dst, const long istrides[D], const complex float* src, bool backwards)
+{
+	bool inplace = (dst == src);
+	int oalign = fftwf_alignment_of((float*)dst);
+	int ialign = fftwf_alignment_of((float*)src);
+
+	struct fft_cache_s* e = NULL;
+
+	#pragma omp critical
+	{
+		fft_cache_setup();
+
+		struct fft_cache_s** pp = &fft_cache;
+		struct fft_cache_s** unused = NULL;
+
+		for (; NULL != *pp; pp = &(*pp)->next) {
+
+			if (fft_cache_match(*pp, D, dimensions, flags, ostrides, istrides, backwards, inplace, oalign, ialign))
+				break;
+
+			if (0 == (*pp)->refs)
+				unused = pp;
+		}
+
+		if (NULL != *pp) {
+
+			e = *pp;
+			*pp = e->next;
+
+		} else {
+
+			// evict the least recently used plan
+
+			if ((fft_cache_entries >= FFT_CACHE_SIZE) && (NULL != unused)) {
+
+				struct fft_cache_s* old = *unused;
+				*unused = old->next;
+				fft_cache_destroy(old);
+			}
+
+			e = xmalloc(sizeof(struct fft_cache_s));
+
+			e->D = D;
+			e->dims = xmalloc(3 * D * sizeof(long));
+			md_copy_dims(D, e->dims, dimensions);
+			md_copy_dims(D, e->dims + D, ostrides);
+			md_copy_dims(D, e->dims + 2 * D, istrides);
+			e->flags = flags;
+			e->backwards = backwards;
+			e->inplace = inplace;
+			e->oalign = oalign;
+			e->ialign = ialign;
+			e->nthreads = fft_nthreads;
+			e->effort = fft_efforts[fft_effort];
+			e->refs = 0;
+			e->fftw = fft_fftwf_plan(D, dimensions, flags, ostrides, dst, istrides, src, backwards);
+
+			fft_cache_entries++;
+
+			debug_printf(DP_DEBUG3, "FFTW plan (%s): %d cached\n", fft_effort_names[fft_effort], fft_cache_entries);
+		}
+
+		e->next = fft_cache;
+		fft_cache = e;
+		e->refs++;
+	}
+
+	return e;
+}
+
+
+static void fft_cache_put(struct fft_cache_s* e)
+{
+	#pragma omp critical
+	e->refs--;
+}
+
+
+/**
+ * Destroy all cached plans which are not in use.
+ */
+void fft_cache_clear(void)
+{
+	#pragma omp critical
+	{
+		struct fft_cache_s** pp = &fft_cache;
+
+		while (NULL != *pp) {
+
+			struct fft_cache_s* e = *pp;
+
+			if (0 == e->refs) {
+
+				*pp = e->next;
+				fft_cache_destroy(e);
+
+			} else {
+
+				pp = &e->next;
+			}
+		}
+	}
+}
+
+
+
+struct fft_plan_s {
+
+	struct fft_cache_s* cache;
+	
+#ifdef  USE_CUDA
+	struct fft_cuda_plan_s* cuplan;
+#endif
+};
+
+
 static void fft_apply(const void* _plan, unsigned int N, void* args[N])
 {
 	complex float* dst = args[0];
@@ -259,8 +558,22 @@ static void fft_apply(const void* _plan, unsigned int N, void* args[N])
 	} else 
 #endif
 	{
-		assert(NULL != plan->fftw);
-		fftwf_execute_dft(plan->fftw, (complex float*)src, dst);
+		struct fft_cache_s* e = plan->cache;
+
+		// the plan may only be executed on arrays with the same alignment
+
+		bool same = (e->inplace == (dst == src))
+			&& (e->oalign == fftwf_alignment_of((float*)dst))
+			&& (e->ialign == fftwf_alignment_of((float*)src));
+
+		if (!same)
+			e = fft_cache_get(e->D, e->dims, e->flags, e->dims + e->D, dst, e->dims + 2 * e->D, src, e->backwards);
+
+		assert(NULL != e->fftw);
+		fftwf_execute_dft(e->fftw, (complex float*)src, dst);
+
+		if (!same)
+			fft_cache_put(e);
 	}
 }
 
@@ -269,7 +582,7 @@ static void fft_free_plan(const void* _data)
 {
 	const struct fft_plan_s* plan = _data;
 
-	fftwf_destroy_plan(plan->fftw);
+	fft_cache_put(plan->cache);
 #ifdef	USE_CUDA
 	if (NULL != plan->cuplan)
 		fft_cuda_free_plan(plan->cuplan);
@@ -281,7 +594,7 @@ const struct operator_s* fft_create2(unsigned int D, const long dimensions[D], u
 {
 	struct fft_plan_s* plan = xmalloc(sizeof(struct fft_plan_s));
 
-	plan->fftw = fft_fftwf_plan(D, dimensions, flags, ostrides, dst, istrides, src, backwards);
+	plan->cache = fft_cache_get(D, dimensions, flags, ostrides, dst, istrides, src, backwards);
 
 #ifdef  USE_CUDA
 	plan->cuplan = NULL;
@@ -434,7 +747,10 @@ void fft_set_num_threads(unsigned int n)
 	}
 
 	#pragma omp critical
-        fftwf_plan_with_nthreads(n);
+	{
+		fftwf_plan_with_nthreads(n);
+		fft_nthreads = n;
+	}
 }
 
 
@@ -89,6 +89,11 @@ extern void fft_free(const struct operator_s* plan);
 
 extern void fft_set_num_threads(unsigned int n);
 
+// plans are cached, see fft.c
+enum fft_planner { FFT_ESTIMATE, FFT_MEASURE, FFT_PATIENT, FFT_EXHAUSTIVE };
+extern void fft_set_planner(enum fft_planner effort);
+extern void fft_cache_clear(void);
+
 
 #ifdef __cplusplus
 }
@@ -38,6 +38,7 @@
 
 #include "misc/misc.h"
 #include "misc/debug.h"
+#include "misc/trace.h"
 
 // automatic parallelization
 extern bool num_auto_parallelize;
@@ -135,6 +136,8 @@ struct data_s {
  */
 static void optimized_twoop(unsigned int D, const long dim[D], const long ostr[D], void* optr, const long istr1[D], void* iptr1, size_t sizes[2], md_nary_fun_t too, void* data_ptr)
 {
+	TRACE_BEGIN();
+
 	long tostr[D];
 	long tistr[D];
 	long tdims[D];
@@ -148,6 +151,13 @@ static void optimized_twoop(unsigned int D, const long dim[D], const long ostr[D
 
 	int ND = optimize_dims(2, D, tdims, nstr2);
 
+#ifdef USE_CUDA
+	if (num_auto_parallelize && !use_gpu(2, nptr))
+#else
+	if (num_auto_parallelize)
+#endif
+		ND = tile_dims(2, ND, D, tdims, nstr2, sizes);
+
 	int skip = min_blockdim(2, ND, tdims, nstr2, sizes);
 
 	unsigned int flags = 0;
@@ -181,6 +191,8 @@ static void optimized_twoop(unsigned int D, const long dim[D], const long ostr[D
 #endif
 
 	md_parallel_nary(2, ND - skip, tdims + skip, flags, nstr, nptr, (void*)&data, too);
+
+	TRACE_END(md_calc_size(D, dim), md_calc_size(D, dim) * (double)(sizes[0] + sizes[1]), "md_2op");
 }
 
 
@@ -221,6 +233,8 @@ static void optimized_twoop_oi(unsigned int D, const long dim[D], const long ost
  */
 static void optimized_threeop(unsigned int D, const long dim[D], const long ostr[D], void* optr, const long istr1[D], void* iptr1, const long istr2[D], void* iptr2, size_t sizes[3], md_nary_fun_t too, void* data_ptr)
 {
+	TRACE_BEGIN();
+
 	long tostr[D];
 	long tistr1[D];
 	long tistr2[D];
@@ -236,6 +250,13 @@ static void optimized_threeop(unsigned int D, const long dim[D], const long ostr
 
 	int ND = optimize_dims(3, D, tdims, nstr2);
 
+#ifdef USE_CUDA
+	if (num_auto_parallelize && !use_gpu(3, nptr))
+#else
+	if (num_auto_parallelize)
+#endif
+		ND = tile_dims(3, ND, D, tdims, nstr2, sizes);
+
 	int skip = min_blockdim(3, ND, tdims, nstr2, sizes);
 	unsigned int flags = 0;
 
@@ -268,6 +289,8 @@ static void optimized_threeop(unsigned int D, const long dim[D], const long ostr
 #endif
 
 	md_parallel_nary(3, ND - skip, tdims + skip, flags, nstr, nptr, (void*)&data, too);
+
+	TRACE_END(md_calc_size(D, dim), md_calc_size(D, dim) * (double)(sizes[0] + sizes[1] + sizes[2]), "md_3op");
 }
 
 /**
@@ -533,6 +533,35 @@ const struct vec_ops gpu_ops = {
 };
 
 
+/*
+ * Fused operations of the iterative algorithms,
+ * composed from the kernels above
+ */
+static double cuda_axpy_dot(long N, float* dst, float alpha, const float* src)
+{
+	cuda_saxpy(N, dst, alpha, src);
+	return cuda_sdot(N, src, dst);
+}
+
+static double cuda_axpy_norm(long N, float* dst, float alpha, const float* src)
+{
+	cuda_saxpy(N, dst, alpha, src);
+	return cuda_norm(N, dst);
+}
+
+static void cuda_axpy_xpay(long N, float* dst, float alpha, float* x, float beta, const float* y)
+{
+	cuda_saxpy(N, dst, alpha, x);
+	cuda_xpay(N, beta, x, y);
+}
+
+static void cuda_dual_resid(long N, float* u, float* r, const float* g, const float* z)
+{
+	cuda_sub(N, u, g, z);
+	cuda_sub(N, r, z, u);
+}
+
+
 // defined in iter/vec.h
 struct vec_iter_s {
 
@@ -551,6 +580,12 @@ struct vec_iter_s {
 	void (*smul)(long N, float alpha, float* a, const float* x);
 	void (*xpay)(long N, float alpha, float* a, const float* x);
 	void (*axpy)(long N, float* a, float alpha, const float* x);
+
+	// fused operations (one pass over all vectors)
+	double (*axpy_dot)(long N, float* a, float alpha, const float* x);
+	double (*axpy_norm)(long N, float* a, float alpha, const float* x);
+	void (*axpy_xpay)(long N, float* a, float alpha, float* x, float beta, const float* y);
+	void (*dual_resid)(long N, float* u, float* r, const float* g, const float* z);
 };
 
 extern const struct vec_iter_s gpu_iter_ops;
@@ -568,6 +603,11 @@ const struct vec_iter_s gpu_iter_ops = {
 	.add = cuda_add,
 	.sub = cuda_sub,
 	.swap = cuda_swap,
+
+	.axpy_dot = cuda_axpy_dot,
+	.axpy_norm = cuda_axpy_norm,
+	.axpy_xpay = cuda_axpy_xpay,
+	.dual_resid = cuda_dual_resid,
 };
 
 
@@ -20,6 +20,7 @@
 #endif
 
 #include "misc/debug.h"
+#include "misc/trace.h"
 #include "num/fft.h"
 
 #ifdef USE_CUDA
@@ -35,6 +36,8 @@
 
 void num_init(void)
 {
+	trace_init();
+
 #ifdef __linux__
 //	feenableexcept(FE_INVALID|FE_DIVBYZERO|FE_OVERFLOW|FE_UNDERFLOW);
 #endif
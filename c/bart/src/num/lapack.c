@@ -16,6 +16,7 @@
 #include <complex.h>
 #include <stdio.h>
 #include <assert.h>
+#include <stdbool.h>
 
 #ifdef USE_CUDA
 #include "num/gpuops.h"
@@ -25,6 +26,7 @@
 
 
 #include "misc/misc.h"
+#include "misc/trace.h"
 
 #include "num/lapack.h"
 
@@ -48,6 +50,11 @@ extern void cgesvd(char jobu, char jobvt, long M, long N, complex float a[M][N],
 extern void cgemm(const char transa, const char transb, long M, long N,  long K, const complex float* alpha, const complex float A[M][K], const long lda, const complex float B[K][N], const long ldb, const complex float* beta, complex float C[M][N], const long ldc );
 extern void csyrk(char uplo, char transa, long N, long K, const complex float *alpha, const complex float A[K][N], const long lda, const complex float *beta, const complex float C[N][N], const long ldc);
 extern void cpotrf_(char uplo, const long N, complex float A[N][N], long lda, long* info);
+extern void cgeqrf(long M, long N, complex float A[N][M], long lda, complex float* tau, long* info);
+extern void cungqr(long M, long N, long K, complex float A[N][M], long lda, const complex float* tau, long* info);
+extern void sgesvd(char jobu, char jobvt, long M, long N, float a[M][N], long lda, float* S, float u[M][N], long ldu, float vt[M][N], long ldvt, long *info);
+extern void sgemm(const char transa, const char transb, long M, long N,  long K, const float* alpha, const float A[M][K], const long lda, const float B[K][N], const long ldb, const float* beta, float C[M][N], const long ldc );
+extern void ssyrk(char uplo, char transa, long N, long K, const float *alpha, const float A[K][N], const long lda, const float *beta, const float C[N][N], const long ldc);
 #else
 // FIXME: this strategy would work but needs explicit casts below
 #include <acml.h>
@@ -63,119 +70,769 @@ extern void cgesvd_(const char jobu[1], const char jobvt[1], const long* M, cons
 extern void cgemm_(const char transa[1], const char transb[1], const long* M, const long* N, const long* K, const complex float* alpha, const complex float A[*M][*K], const long* lda, const complex float B[*K][*N], const long* ldb, const complex float* beta, complex float C[*M][*N], const long* ldc );
 extern void csyrk_(const char uplo[1], const char trans[1], const long* N, const long* K, const complex float* alpha, const complex float A[*N][*K], const long* lda, const complex float* beta, const complex float C[*N][*N], const long* ldc);
 extern void cpotrf_(const char uplo[1], const long* N, complex float A[*N][*N], const long* lda, long* info);
+extern void cgeqrf_(const long* M, const long* N, complex float A[*N][*M], const long* lda, complex float* tau, complex float* work, const long* lwork, long* info);
+extern void cungqr_(const long* M, const long* N, const long* K, complex float A[*N][*M], const long* lda, const complex float* tau, complex float* work, const long* lwork, long* info);
+extern void sgesvd_(const char jobu[1], const char jobvt[1], const long* M, const long* N, float A[*M][*N], const long* lda, float* s, float U[*M][*N], long* ldu, float VH[*M][*N], long* ldvt, float* work, long* lwork, long* info);
+extern void sgemm_(const char transa[1], const char transb[1], const long* M, const long* N, const long* K, const float* alpha, const float A[*M][*K], const long* lda, const float B[*K][*N], const long* ldb, const float* beta, float C[*M][*N], const long* ldc );
+extern void ssyrk_(const char uplo[1], const char trans[1], const long* N, const long* K, const float* alpha, const float A[*N][*K], const long* lda, const float* beta, const float C[*N][*N], const long* ldc);
 #endif
 
-void batch_svthresh(long M, long N, long num_blocks, float lambda, complex float* dst, const complex float* src)
+/**
+ * Workspace for singular value thresholding of M x N blocks.
+ * Each thread owns one workspace so that blocks can be
+ * processed concurrently. The real-valued SVT uses the
+ * same buffers.
+ */
+struct svthresh_work_s {
+
+	long M;
+	long N;
+
+	complex float* U;
+	complex float* VT;
+	float* S;
+	complex float* AA;
+
+	enum svthresh_method method;
+
+#ifndef USE_ACML
+	long lwork;
+	long slwork;
+	complex float* work;
+	float* rwork;
+	long* iwork;
+
+	// workspace of cgesdd_ or cheev_ (see svthresh_work_set_method)
+	long xlwork;
+	complex float* xwork;
+	float* xrwork;
+#endif
+};
+
+
+const char* svthresh_method_name[] = { "auto", "gesvd", "gesdd", "jacobi", "gram" };
+
+
+// blocks up to this size use one-sided Jacobi instead of cgesvd_
+#define SVT_JACOBI_MAXSIZE 8
+#define SVT_JACOBI_SWEEPS 30
+#define SVT_JACOBI_TOL 1.E-6
+
+
+#ifndef USE_ACML
+/*
+ * Optimal lwork of cgesvd_ (or sgesvd_) for economy-size SVDs, cached
+ * per shape so that the workspace query is only done once for each (M, N).
+ */
+#define LWORK_CACHE_SIZE 64
+
+static struct { long M; long N; bool real; long lwork; } lwork_cache[LWORK_CACHE_SIZE];
+static int lwork_cache_num = 0;
+
+static long svd_econ_lwork(long M, long N, bool real)
 {
+	long lwork = -1;
+
+	#pragma omp critical (lwork_cache)
+	for (int i = 0; i < lwork_cache_num; i++)
+		if ((lwork_cache[i].M == M) && (lwork_cache[i].N == N) && (lwork_cache[i].real == real))
+			lwork = lwork_cache[i].lwork;
+
+	if (-1 != lwork)
+		return lwork;
+
 	long info = 0;
+	long minMN = MIN(M, N);
+	complex float work1[1];
+	float S[1];
+	complex float U[1];
+	complex float VT[1];
+	float* rwork = xmalloc(5 * N * sizeof(float));
+	long* iwork = xmalloc(8 * minMN * sizeof(long));
+
+	// get optimal block size
+	if (real) {
+
+		float swork1[1];
+		sgesvd_("S", "S", &M, &N, NULL, &M, S, (float (*)[minMN])U, &M, (float (*)[N])VT, &minMN, swork1, &lwork, &info);
+		work1[0] = swork1[0];
+
+	} else {
+
+		cgesvd_("S", "S", &M, &N, NULL, &M, S, (complex float (*)[minMN])U, &M, (complex float (*)[N])VT, &minMN, work1, &lwork, rwork, iwork, &info);
+	}
+
+	free(rwork);
+	free(iwork);
+
+	lwork = (int)crealf(work1[0]);
+
+	#pragma omp critical (lwork_cache)
+	if (lwork_cache_num < LWORK_CACHE_SIZE) {
+
+		lwork_cache[lwork_cache_num].M = M;
+		lwork_cache[lwork_cache_num].N = N;
+		lwork_cache[lwork_cache_num].real = real;
+		lwork_cache[lwork_cache_num].lwork = lwork;
+		lwork_cache_num++;
+	}
+
+	return lwork;
+}
+#endif
+
+
+struct svthresh_work_s* svthresh_work_create(long M, long N)
+{
+	struct svthresh_work_s* ws = xmalloc(sizeof(struct svthresh_work_s));
 
 	long minMN = MIN(M, N);
+
+	ws->M = M;
+	ws->N = N;
+
 	// create u, v, s
-	complex float* U = xmalloc(M * minMN * sizeof(complex float));
-	complex float* VT = xmalloc(minMN * N * sizeof(complex float));
-	float* S = xmalloc(minMN * sizeof(float));
+	ws->U = xmalloc(M * minMN * sizeof(complex float));
+	ws->VT = xmalloc(minMN * N * sizeof(complex float));
+	ws->S = xmalloc(minMN * sizeof(float));
 
+	// create AA
+	ws->AA = xmalloc(minMN * minMN * sizeof(complex float));
 
 #ifndef USE_ACML
 	// create lrwork
+	ws->rwork = xmalloc(5 * N * sizeof(float));
+	ws->iwork = xmalloc(8 * minMN * sizeof(long));
+
+	// create work
+	ws->lwork = svd_econ_lwork(M, N, false);
+	ws->slwork = svd_econ_lwork(M, N, true);
+	ws->work = xmalloc(MAX(ws->lwork * sizeof(complex float), ws->slwork * sizeof(float)));
+
+	ws->xlwork = 0;
+	ws->xwork = NULL;
+	ws->xrwork = NULL;
+#endif
+
+	ws->method = SVT_METHOD_AUTO;
+
+	return ws;
+}
+
+
+/**
+ * Select the algorithm used by block_svthresh. SVT_METHOD_AUTO
+ * uses Jacobi for small blocks and cgesvd_ otherwise. Blocks with
+ * a single row or column are always thresholded directly.
+ */
+void svthresh_work_set_method(struct svthresh_work_s* ws, enum svthresh_method method)
+{
+	ws->method = method;
+
+#ifndef USE_ACML
+	free(ws->xwork);
+	free(ws->xrwork);
+
+	ws->xlwork = 0;
+	ws->xwork = NULL;
+	ws->xrwork = NULL;
+
+	long M = ws->M;
+	long N = ws->N;
+	long minMN = MIN(M, N);
+	long info = 0;
 	long lwork = -1;
 	complex float work1[1];
-	float* rwork = xmalloc(5 * N * sizeof(float));
-	long* iwork = xmalloc(8 * minMN * sizeof(long));
 
-	// get optimal block size, create work
-	// i + j * lda
-	cgesvd_("S", "S", &M, &N, (complex float (*)[N])src, &M, S, (complex float (*)[minMN])U, &M, (complex float (*)[N])VT, &minMN, work1, &lwork, rwork, iwork, &info);
+	if (SVT_METHOD_GESDD == method) {
 
-	lwork = (int)work1[0];
-	complex float* work = xmalloc(lwork * sizeof(complex float));
+		ws->xrwork = xmalloc(minMN * MAX(5 * minMN + 7, 2 * MAX(M, N) + 2 * minMN + 1) * sizeof(float));
+
+		cgesdd_("S", &M, &N, NULL, &M, ws->S, NULL, &M, NULL, &minMN, work1, &lwork, ws->xrwork, ws->iwork, &info);
+	}
+
+	if (SVT_METHOD_GRAM == method) {
+
+		ws->xrwork = xmalloc(MAX(1, 3 * minMN - 2) * sizeof(float));
+
+		cheev_("V", "U", &minMN, NULL, &minMN, ws->S, work1, &lwork, ws->xrwork, &info);
+	}
+
+	if ((SVT_METHOD_GESDD == method) || (SVT_METHOD_GRAM == method)) {
+
+		ws->xlwork = (long)crealf(work1[0]);
+		ws->xwork = xmalloc(ws->xlwork * sizeof(complex float));
+	}
 #endif
+}
 
 
-	// create AA
-	complex float* AA = xmalloc(minMN * minMN * sizeof(complex float));
+/**
+ * Size of the workspace in bytes
+ */
+long svthresh_work_size(const struct svthresh_work_s* ws)
+{
+	long minMN = MIN(ws->M, ws->N);
 
+	long size = (ws->M * minMN + minMN * ws->N + minMN * minMN) * sizeof(complex float) + minMN * sizeof(float);
+#ifndef USE_ACML
+	size += MAX(ws->lwork * sizeof(complex float), ws->slwork * sizeof(float)) + 5 * ws->N * sizeof(float) + 8 * minMN * sizeof(long);
+#endif
+	return size;
+}
 
-	for (int b = 0; b < num_blocks; b++) {
 
-		const complex float* src_b = src + b * M * N;
-		complex float* dst_b = dst + b * M * N;
+void svthresh_work_free(struct svthresh_work_s* ws)
+{
+	free(ws->U);
+	free(ws->VT);
+	free(ws->S);
+	free(ws->AA);
 
-		// Compute upper bound | A^T A |_inf
-		float s_upperbound = 0;
+#ifndef USE_ACML
+	free(ws->work);
+	free(ws->iwork);
+	free(ws->rwork);
+	free(ws->xwork);
+	free(ws->xrwork);
+#endif
+	free(ws);
+}
+
+
+/**
+ * Nuclear norm of the result of the last block_svthresh,
+ * which returned rank.
+ */
+float svthresh_work_nucnorm(const struct svthresh_work_s* ws, long rank, float lambda)
+{
+	float nn = 0.;
 
-		if (M <= N)
+	for (long i = 0; i < rank; i++)
+		nn += ws->S[i] - lambda;
+
+	return nn;
+}
+
+
+/**
+ * Upper bound for the squared largest singular value of an
+ * M x N block, used to skip the SVD of blocks which are
+ * thresholded to zero.
+ */
+float svthresh_bound(struct svthresh_work_s* ws, const complex float* src)
+{
+	long M = ws->M;
+	long N = ws->N;
+	long minMN = MIN(M, N);
+
+	complex float* AA = ws->AA;
+
+	// Compute upper bound | A^T A |_inf
+	float s_upperbound = 0;
+
+	if (M <= N)
 #ifdef USE_ACML
-			csyrk('U', 'N', M, N, &(const complex float){ 1. }, (const complex float (*)[])src_b, M, &(const complex float){ 0. }, (const complex float (*)[])AA, minMN);
+		csyrk('U', 'N', M, N, &(const complex float){ 1. }, (const complex float (*)[])src, M, &(const complex float){ 0. }, (const complex float (*)[])AA, minMN);
 #else
-			csyrk_("U", "N", &M, &N, &(const complex float){ 1. }, (const complex float (*)[])src_b, &M, &(const complex float){ 0. }, (const complex float (*)[])AA, &minMN);
+		csyrk_("U", "N", &M, &N, &(const complex float){ 1. }, (const complex float (*)[])src, &M, &(const complex float){ 0. }, (const complex float (*)[])AA, &minMN);
 #endif
-		else
+	else
 #ifdef USE_ACML
-			csyrk('U', 'T', N, M, &(const complex float){ 1. }, (const complex float(*)[])src_b, M, &(const complex float){ 0. }, (const complex float (*)[])AA, minMN);
+		csyrk('U', 'T', N, M, &(const complex float){ 1. }, (const complex float(*)[])src, M, &(const complex float){ 0. }, (const complex float (*)[])AA, minMN);
 #else
-			csyrk_("U", "T", &N, &M, &(const complex float){ 1. }, (const complex float(*)[])src_b, &M, &(const complex float){ 0. }, (const complex float (*)[]) AA, &minMN);
+		csyrk_("U", "T", &N, &M, &(const complex float){ 1. }, (const complex float(*)[])src, &M, &(const complex float){ 0. }, (const complex float (*)[]) AA, &minMN);
 #endif
 
+	// lambda_max( A ) <= max_i sum_j | a_i^T a_j |
+	for (int i = 0; i < minMN; i++)
+	{
+		float s = 0;
+
+		for (int j = 0; j < minMN; j++)
+			s += cabsf(AA[MIN(i, j) + MAX(i, j) * minMN]);
+
+		s_upperbound = MAX(s_upperbound, s);
+	}
+
+	return s_upperbound;
+}
+
+
+/*
+ * SVT of a single row or column: soft-thresholding of its norm.
+ */
+static long vec_svthresh(long MN, float lambda, float* S, complex float* dst, const complex float* src)
+{
+	float nrm = 0.;
+
+	for (long i = 0; i < MN; i++)
+		nrm += crealf(src[i] * conjf(src[i]));
+
+	nrm = sqrtf(nrm);
+	S[0] = nrm;
+
+	float s = (nrm > lambda) ? (1. - lambda / nrm) : 0.;
+
+	for (long i = 0; i < MN; i++)
+		dst[i] = s * src[i];
+
+	return (s > 0.) ? 1 : 0;
+}
+
+
+
+/*
+ * SVT of a small block by one-sided (Hestenes) Jacobi. The shorter
+ * dimension K = min(M, N) is orthogonalized: the columns of A if
+ * N <= M and the columns of A^T otherwise, so that A V = W with
+ * orthogonal columns and W = U S. The thresholded block is W' V^H
+ * (or its transpose), with the columns of W shrunk. V is K x K.
+ * Destroys src. Sorts S in descending order.
+ */
+static long jacobi_svthresh(long M, long N, float lambda, float* S, complex float* V, complex float* dst, complex float* src)
+{
+	long K = MIN(M, N);
+	long L = MAX(M, N);
+	long ks = (N <= M) ? M : 1;
+	long is = (N <= M) ? 1 : M;
+
+	for (long k = 0; k < K; k++)
+		for (long j = 0; j < K; j++)
+			V[j + k * K] = (j == k) ? 1. : 0.;
+
+	for (int sweep = 0; sweep < SVT_JACOBI_SWEEPS; sweep++) {
+
+		bool rotated = false;
+
+		for (long p = 0; p < K; p++) {
+
+			for (long q = p + 1; q < K; q++) {
 
+				complex float* ap = src + p * ks;
+				complex float* aq = src + q * ks;
 
-		// lambda_max( A ) <= max_i sum_j | a_i^T a_j |
-		for (int i = 0; i < minMN; i++)
-		{
-			float s = 0;
+				float alpha = 0.;
+				float beta = 0.;
+				complex float gamma = 0.;
 
-			for (int j = 0; j < minMN; j++)
-				s += cabsf(AA[MIN(i, j) + MAX(i, j) * minMN]);
+				for (long i = 0; i < L; i++) {
 
-			s_upperbound = MAX(s_upperbound, s);
+					alpha += crealf(ap[i * is] * conjf(ap[i * is]));
+					beta += crealf(aq[i * is] * conjf(aq[i * is]));
+					gamma += conjf(ap[i * is]) * aq[i * is];
+				}
+
+				float g = cabsf(gamma);
+
+				if (g <= SVT_JACOBI_TOL * sqrtf(alpha * beta))
+					continue;
+
+				rotated = true;
+
+				// remove the phase of gamma, then a real rotation
+				complex float e = conjf(gamma) / g;
+				float zeta = (beta - alpha) / (2. * g);
+				float t = copysignf(1., zeta) / (fabsf(zeta) + sqrtf(1. + zeta * zeta));
+				float c = 1. / sqrtf(1. + t * t);
+				float s = c * t;
+
+				for (long i = 0; i < L; i++) {
+
+					complex float x = ap[i * is];
+					complex float y = e * aq[i * is];
+
+					ap[i * is] = c * x - s * y;
+					aq[i * is] = s * x + c * y;
+				}
+
+				for (long j = 0; j < K; j++) {
+
+					complex float x = V[j + p * K];
+					complex float y = e * V[j + q * K];
+
+					V[j + p * K] = c * x - s * y;
+					V[j + q * K] = s * x + c * y;
+				}
+			}
+		}
+
+		if (!rotated)
+			break;
+	}
+
+	// shrink columns of W
+	float f[K];
+	long rank = 0;
+
+	for (long k = 0; k < K; k++) {
+
+		float nrm = 0.;
+
+		for (long i = 0; i < L; i++)
+			nrm += crealf(src[k * ks + i * is] * conjf(src[k * ks + i * is]));
+
+		S[k] = sqrtf(nrm);
+		f[k] = (S[k] > lambda) ? (1. - lambda / S[k]) : 0.;
+
+		if (f[k] > 0.)
+			rank++;
+	}
+
+	// dst = W' V^H, one row of W at a time so that dst may alias src
+	complex float w[K];
+
+	for (long i = 0; i < L; i++) {
+
+		for (long k = 0; k < K; k++)
+			w[k] = f[k] * src[k * ks + i * is];
+
+		for (long j = 0; j < K; j++) {
+
+			complex float sum = 0.;
+
+			for (long k = 0; k < K; k++)
+				sum += w[k] * conjf(V[j + k * K]);
+
+			dst[j * ks + i * is] = sum;
 		}
+	}
 
-		if (s_upperbound < lambda * lambda) {
+	// descending, as returned by cgesvd_
+	for (long k = 1; k < K; k++)
+		for (long j = k; (j > 0) && (S[j - 1] < S[j]); j--) {
 
-			for (int i = 0; i < M * N; i++)
-				dst_b[i] = 0.;
+			float tmp = S[j];
+			S[j] = S[j - 1];
+			S[j - 1] = tmp;
+		}
+
+	return rank;
+}
 
-		} else {
 
 
+/*
+ * SVT from the eigendecomposition of the Gram matrix of the shorter
+ * side. Only accurate to about sqrt(eps) relative to the largest
+ * singular value, but cheap for tall and skinny blocks.
+ */
+static long gram_svthresh(struct svthresh_work_s* ws, float lambda, complex float* dst, const complex float* src)
+{
+	long info = 0;
+
+	long M = ws->M;
+	long N = ws->N;
+	long K = MIN(M, N);
+
+	complex float* C = ws->AA;
+	float* S = ws->S;
+
+	const complex float one = 1.;
+	const complex float zero = 0.;
+
 #ifdef USE_ACML
-			cgesvd('S', 'S', M, N, (complex float (*)[])src_b, M, S, (complex float (*)[])U, M, (complex float (*)[])VT, minMN, &info);
+	if (N <= M)
+		cgemm('C', 'N', N, N, M, &one, (const complex float (*)[])src, M, (const complex float (*)[])src, M, &zero, (complex float (*)[])C, K);
+	else
+		cgemm('N', 'C', M, M, N, &one, (const complex float (*)[])src, M, (const complex float (*)[])src, M, &zero, (complex float (*)[])C, K);
+
+	cheev('V', 'U', K, (complex float (*)[])C, K, S, &info);
 #else
-			cgesvd_("S", "S", &M, &N, (complex float (*)[])src_b, &M, S, (complex float (*)[])U, &M, (complex float (*)[]) VT, &minMN, work, &lwork, rwork, iwork, &info);
+	if (N <= M)
+		cgemm_("C", "N", &N, &N, &M, &one, (const complex float (*)[])src, &M, (const complex float (*)[])src, &M, &zero, (complex float (*)[])C, &K);
+	else
+		cgemm_("N", "C", &M, &M, &N, &one, (const complex float (*)[])src, &M, (const complex float (*)[])src, &M, &zero, (complex float (*)[])C, &K);
+
+	cheev_("V", "U", &K, (complex float (*)[])C, &K, S, ws->xwork, &ws->xlwork, ws->xrwork, &info);
 #endif
 
+	float f[K];
+	long rank = 0;
 
-			// Soft Threshold
-			for (int i = 0; i < minMN; i++ ) {
+	for (long k = 0; k < K; k++) {
 
-				float s = S[i] - lambda;
+		S[k] = sqrtf(MAX(S[k], 0.));
+		f[k] = (S[k] > lambda) ? (1. - lambda / S[k]) : 0.;
 
-				s = (s + fabsf(s)) / 2.;
+		if (f[k] > 0.)
+			rank++;
+	}
 
-				for ( int j = 0; j < N; j++ )
-					VT[i + j * minMN] *= s;
-			}
+	if (N <= M) {
+
+		// dst = (A V) diag(f) V^H
+		complex float* W = ws->U;
 
 #ifdef USE_ACML
-			cgemm('N', 'N', M, N, minMN, &(complex float){ 1. }, (const complex float (*)[])U, M, (const complex float (*)[])VT, minMN, &(const complex float){ 0. }, (complex float (*)[])dst_b, M);
+		cgemm('N', 'N', M, K, N, &one, (const complex float (*)[])src, M, (const complex float (*)[])C, K, &zero, (complex float (*)[])W, M);
 #else
-			cgemm_("N", "N", &M, &N, &minMN, &(complex float){ 1. }, (const complex float (*)[])U, &M, (const complex float (*)[])VT, &minMN, &(complex float){ 0. }, (complex float (*)[])dst_b, &M);
+		cgemm_("N", "N", &M, &K, &N, &one, (const complex float (*)[])src, &M, (const complex float (*)[])C, &K, &zero, (complex float (*)[])W, &M);
 #endif
+		for (long k = 0; k < K; k++)
+			for (long i = 0; i < M; i++)
+				W[i + k * M] *= f[k];
 
-		}
+#ifdef USE_ACML
+		cgemm('N', 'C', M, N, K, &one, (const complex float (*)[])W, M, (const complex float (*)[])C, K, &zero, (complex float (*)[])dst, M);
+#else
+		cgemm_("N", "C", &M, &N, &K, &one, (const complex float (*)[])W, &M, (const complex float (*)[])C, &K, &zero, (complex float (*)[])dst, &M);
+#endif
+	} else {
+
+		// dst = U diag(f) (U^H A)
+		complex float* W = ws->VT;
+
+#ifdef USE_ACML
+		cgemm('C', 'N', K, N, M, &one, (const complex float (*)[])C, M, (const complex float (*)[])src, M, &zero, (complex float (*)[])W, K);
+#else
+		cgemm_("C", "N", &K, &N, &M, &one, (const complex float (*)[])C, &M, (const complex float (*)[])src, &M, &zero, (complex float (*)[])W, &K);
+#endif
+		for (long j = 0; j < N; j++)
+			for (long k = 0; k < K; k++)
+				W[k + j * K] *= f[k];
+
+#ifdef USE_ACML
+		cgemm('N', 'N', M, N, K, &one, (const complex float (*)[])C, M, (const complex float (*)[])W, K, &zero, (complex float (*)[])dst, M);
+#else
+		cgemm_("N", "N", &M, &N, &K, &one, (const complex float (*)[])C, &M, (const complex float (*)[])W, &K, &zero, (complex float (*)[])dst, &M);
+#endif
 	}
 
-	free(U);
-	free(VT);
-	free(S);
-	free(AA);
+	// eigenvalues are ascending
+	for (long k = 0; k < K / 2; k++) {
 
-#ifndef USE_ACML
+		float tmp = S[k];
+		S[k] = S[K - 1 - k];
+		S[K - 1 - k] = tmp;
+	}
 
-	free(work);
-	free(iwork);
-	free(rwork);
+	return rank;
+}
+
+
+
+/**
+ * Singular value thresholding of a single M x N block
+ * using a preallocated workspace. Destroys src.
+ * Rows and columns are shrunk directly and small blocks
+ * use Jacobi instead of cgesvd_.
+ *
+ * Returns the number of singular values above lambda.
+ */
+long block_svthresh(struct svthresh_work_s* ws, float lambda, complex float* dst, const complex float* src)
+{
+	long info = 0;
+
+	long M = ws->M;
+	long N = ws->N;
+	long minMN = MIN(M, N);
+
+	complex float* U = ws->U;
+	complex float* VT = ws->VT;
+	float* S = ws->S;
+
+	// the same early-out for all shapes (and in lrthresh for the
+	// randomized SVT), so that all paths agree on zero blocks
+	float s_upperbound = svthresh_bound(ws, src);
+
+	if (s_upperbound < lambda * lambda) {
+
+		for (int i = 0; i < M * N; i++)
+			dst[i] = 0.;
+
+		return 0;
+	}
+
+	if (1 == minMN)
+		return vec_svthresh(M * N, lambda, S, dst, src);
+
+	enum svthresh_method method = ws->method;
+
+	if (SVT_METHOD_AUTO == method)
+		method = (minMN <= SVT_JACOBI_MAXSIZE) ? SVT_METHOD_JACOBI : SVT_METHOD_GESVD;
+
+	if (SVT_METHOD_JACOBI == method)
+		return jacobi_svthresh(M, N, lambda, S, ws->AA, dst, (complex float*)src);
+
+	if (SVT_METHOD_GRAM == method)
+		return gram_svthresh(ws, lambda, dst, src);
+
+#ifdef USE_ACML
+	if (SVT_METHOD_GESDD == method)
+		cgesdd('S', M, N, (complex float (*)[])src, M, S, (complex float (*)[])U, M, (complex float (*)[])VT, minMN, &info);
+	else
+		cgesvd('S', 'S', M, N, (complex float (*)[])src, M, S, (complex float (*)[])U, M, (complex float (*)[])VT, minMN, &info);
+#else
+	if (SVT_METHOD_GESDD == method)
+		cgesdd_("S", &M, &N, (complex float (*)[])src, &M, S, (complex float (*)[])U, &M, (complex float (*)[]) VT, &minMN, ws->xwork, &ws->xlwork, ws->xrwork, ws->iwork, &info);
+	else
+		cgesvd_("S", "S", &M, &N, (complex float (*)[])src, &M, S, (complex float (*)[])U, &M, (complex float (*)[]) VT, &minMN, ws->work, &ws->lwork, ws->rwork, ws->iwork, &info);
+#endif
+
+
+	// Soft Threshold
+	long rank = 0;
+
+	for (int i = 0; i < minMN; i++ ) {
+
+		float s = S[i] - lambda;
+
+		s = (s + fabsf(s)) / 2.;
+
+		if (s > 0.)
+			rank++;
+
+		for ( int j = 0; j < N; j++ )
+			VT[i + j * minMN] *= s;
+	}
+
+#ifdef USE_ACML
+	cgemm('N', 'N', M, N, minMN, &(complex float){ 1. }, (const complex float (*)[])U, M, (const complex float (*)[])VT, minMN, &(const complex float){ 0. }, (complex float (*)[])dst, M);
+#else
+	cgemm_("N", "N", &M, &N, &minMN, &(complex float){ 1. }, (const complex float (*)[])U, &M, (const complex float (*)[])VT, &minMN, &(complex float){ 0. }, (complex float (*)[])dst, &M);
+#endif
+
+	return rank;
+}
+
+
+/**
+ * Upper bound as in svthresh_bound for a real M x N block.
+ */
+float svthresh_bound_real(struct svthresh_work_s* ws, const float* src)
+{
+	long M = ws->M;
+	long N = ws->N;
+	long minMN = MIN(M, N);
+
+	float* AA = (float*)ws->AA;
+
+	float s_upperbound = 0;
+
+	if (M <= N)
+#ifdef USE_ACML
+		ssyrk('U', 'N', M, N, &(const float){ 1. }, (const float (*)[])src, M, &(const float){ 0. }, (const float (*)[])AA, minMN);
+#else
+		ssyrk_("U", "N", &M, &N, &(const float){ 1. }, (const float (*)[])src, &M, &(const float){ 0. }, (const float (*)[])AA, &minMN);
+#endif
+	else
+#ifdef USE_ACML
+		ssyrk('U', 'T', N, M, &(const float){ 1. }, (const float (*)[])src, M, &(const float){ 0. }, (const float (*)[])AA, minMN);
+#else
+		ssyrk_("U", "T", &N, &M, &(const float){ 1. }, (const float (*)[])src, &M, &(const float){ 0. }, (const float (*)[])AA, &minMN);
+#endif
+
+	for (int i = 0; i < minMN; i++)
+	{
+		float s = 0;
+
+		for (int j = 0; j < minMN; j++)
+			s += fabsf(AA[MIN(i, j) + MAX(i, j) * minMN]);
+
+		s_upperbound = MAX(s_upperbound, s);
+	}
+
+	return s_upperbound;
+}
+
+
+/**
+ * Singular value thresholding of a single real M x N block
+ * with sgesvd_/sgemm_. Destroys src.
+ *
+ * Returns the number of singular values above lambda.
+ */
+long block_svthresh_real(struct svthresh_work_s* ws, float lambda, float* dst, const float* src)
+{
+	long info = 0;
+
+	long M = ws->M;
+	long N = ws->N;
+	long minMN = MIN(M, N);
+
+	float* U = (float*)ws->U;
+	float* VT = (float*)ws->VT;
+	float* S = ws->S;
+
+	if (1 == minMN) {
+
+		float nrm = 0.;
+
+		for (long i = 0; i < M * N; i++)
+			nrm += src[i] * src[i];
+
+		S[0] = sqrtf(nrm);
+
+		float s = (S[0] > lambda) ? (1. - lambda / S[0]) : 0.;
+
+		for (long i = 0; i < M * N; i++)
+			dst[i] = s * src[i];
+
+		return (s > 0.) ? 1 : 0;
+	}
+
+	if (svthresh_bound_real(ws, src) < lambda * lambda) {
+
+		for (int i = 0; i < M * N; i++)
+			dst[i] = 0.;
+
+		return 0;
+	}
+
+#ifdef USE_ACML
+	sgesvd('S', 'S', M, N, (float (*)[])src, M, S, (float (*)[])U, M, (float (*)[])VT, minMN, &info);
+#else
+	sgesvd_("S", "S", &M, &N, (float (*)[])src, &M, S, (float (*)[])U, &M, (float (*)[])VT, &minMN, (float*)ws->work, &ws->slwork, &info);
+#endif
+
+	long rank = 0;
+
+	for (int i = 0; i < minMN; i++) {
+
+		float s = S[i] - lambda;
+
+		s = (s + fabsf(s)) / 2.;
+
+		if (s > 0.)
+			rank++;
+
+		for (int j = 0; j < N; j++)
+			VT[i + j * minMN] *= s;
+	}
+
+#ifdef USE_ACML
+	sgemm('N', 'N', M, N, minMN, &(float){ 1. }, (const float (*)[])U, M, (const float (*)[])VT, minMN, &(const float){ 0. }, (float (*)[])dst, M);
+#else
+	sgemm_("N", "N", &M, &N, &minMN, &(float){ 1. }, (const float (*)[])U, &M, (const float (*)[])VT, &minMN, &(float){ 0. }, (float (*)[])dst, &M);
 #endif
+
+	return rank;
+}
+
+
+/**
+ * Singular value thresholding of num_blocks consecutive M x N blocks.
+ * Blocks are distributed over threads, each with its own workspace.
+ * Every block is processed by exactly one thread, so the result does
+ * not depend on the number of threads.
+ */
+void batch_svthresh(long M, long N, long num_blocks, float lambda, complex float* dst, const complex float* src)
+{
+	TRACE_BEGIN();
+
+	#pragma omp parallel if (num_blocks > 1)
+	{
+		struct svthresh_work_s* ws = svthresh_work_create(M, N);
+
+		#pragma omp for schedule(dynamic)
+		for (long b = 0; b < num_blocks; b++)
+			block_svthresh(ws, lambda, dst + b * M * N, src + b * M * N);
+
+		svthresh_work_free(ws);
+	}
+
+	TRACE_END(4. * num_blocks * M * N * MIN(M, N), 2. * num_blocks * M * N * sizeof(complex float), "batch_svthresh");
 }
 
 
@@ -445,4 +1102,60 @@ void lapack_cholesky(long N, complex float A[N][N])
 }
 
 
+/**
+ * Replace the columns of the M x N matrix A (M >= N)
+ * by an orthonormal basis of their span (thin QR).
+ */
+void lapack_orthonormalize(long M, long N, complex float A[N][M])
+{
+	long info = 0;
+
+	assert(M >= N);
+
+	complex float* tau = xmalloc(N * sizeof(complex float));
+
+#ifdef USE_ACML
+	cgeqrf(M, N, A, M, tau, &info);
+
+	if (0 != info)
+		goto err;
+
+	cungqr(M, N, N, A, M, tau, &info);
+#else
+	long lwork = -1;
+	complex float work1[1];
+
+	cgeqrf_(&M, &N, A, &M, tau, work1, &lwork, &info);
+
+	if (0 != info)
+		goto err;
+
+	lwork = (int)work1[0];
+
+	cungqr_(&M, &N, &N, A, &M, tau, work1, &(long){ -1 }, &info);
+
+	if (0 != info)
+		goto err;
+
+	lwork = MAX(lwork, (long)(int)work1[0]);
 
+	complex float* work = xmalloc(MAX(1, lwork) * sizeof(complex float));
+
+	cgeqrf_(&M, &N, A, &M, tau, work, &lwork, &info);
+
+	if (0 == info)
+		cungqr_(&M, &N, &N, A, &M, tau, work, &lwork, &info);
+
+	free(work);
+#endif
+	free(tau);
+
+	if (0 != info)
+		goto err;
+
+	return;
+
+err:
+	fprintf(stderr, "qr failed %ld\n", info);
+	abort();
+}
@@ -3,6 +3,9 @@
  * a BSD-style license which can be found in the LICENSE file.
  */ 
 
+#ifndef __LAPACK_H
+#define __LAPACK_H
+
 #include <complex.h>
 
 #ifdef __cplusplus
@@ -22,7 +25,22 @@ extern void lapack_svd_double(long M, long N, complex double U[M][M], complex do
 extern void lapack_matrix_multiply(long M, long N, long K, complex float C[M][N], const complex float A[M][K], const complex float B[K][N]);
 extern void cgemm_sameplace(const char transa, const char transb, long M, long N, long K, const complex float* alpha, const complex float A[M][K], const long lda, const complex float B[K][N], const long ldb, const complex float* beta, complex float C[M][N], const long ldc);
 
+enum svthresh_method { SVT_METHOD_AUTO, SVT_METHOD_GESVD, SVT_METHOD_GESDD, SVT_METHOD_JACOBI, SVT_METHOD_GRAM };
+extern const char* svthresh_method_name[];
+
+struct svthresh_work_s;
+extern struct svthresh_work_s* svthresh_work_create(long M, long N);
+extern void svthresh_work_free(struct svthresh_work_s* ws);
+extern void svthresh_work_set_method(struct svthresh_work_s* ws, enum svthresh_method method);
+extern long svthresh_work_size(const struct svthresh_work_s* ws);
+extern float svthresh_work_nucnorm(const struct svthresh_work_s* ws, long rank, float lambda);
+extern float svthresh_bound(struct svthresh_work_s* ws, const complex float* src);
+extern long block_svthresh(struct svthresh_work_s* ws, float lambda, complex float* dst, const complex float* src);
+extern float svthresh_bound_real(struct svthresh_work_s* ws, const float* src);
+extern long block_svthresh_real(struct svthresh_work_s* ws, float lambda, float* dst, const float* src);
 extern void batch_svthresh(long M, long N, long num_blocks, float lambda, complex float* dst, const complex float* src);
 
 extern void lapack_cholesky(long N, complex float A[N][N]);
+extern void lapack_orthonormalize(long M, long N, complex float A[N][M]);
 
+#endif
@@ -0,0 +1,112 @@
+/* Copyright 2026. The Regents of the University of California.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ *
+ * Authors:
+ * 2026 agent <agent@local>
+ *
+ * Thin wrappers around MPI. Without USE_MPI there is a single
+ * process and all collectives are no-ops.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#include "misc/misc.h"
+
+#include "mpi.h"
+
+
+void mpi_init(int* argc, char*** argv)
+{
+#ifdef USE_MPI
+	int flag;
+	MPI_Initialized(&flag);
+
+	if (!flag)
+		MPI_Init(argc, argv);
+#else
+	UNUSED(argc);
+	UNUSED(argv);
+#endif
+}
+
+
+void mpi_finalize(void)
+{
+#ifdef USE_MPI
+	MPI_Finalize();
+#endif
+}
+
+
+int mpi_get_rank(void)
+{
+	int rank = 0;
+#ifdef USE_MPI
+	int flag;
+	MPI_Initialized(&flag);
+
+	if (flag)
+		MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+	return rank;
+}
+
+
+int mpi_get_size(void)
+{
+	int size = 1;
+#ifdef USE_MPI
+	int flag;
+	MPI_Initialized(&flag);
+
+	if (flag)
+		MPI_Comm_size(MPI_COMM_WORLD, &size);
+#endif
+	return size;
+}
+
+
+/*
+ * Sum N floats over all processes, in place. Large arrays are
+ * reduced in pieces, as MPI counts are int.
+ */
+void mpi_allreduce_sum(long N, float* x)
+{
+#ifdef USE_MPI
+	if (1 == mpi_get_size())
+		return;
+
+	for (long i = 0; i < N; i += INT_MAX)
+		MPI_Allreduce(MPI_IN_PLACE, x + i, (int)MIN(N - i, (long)INT_MAX), MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+#else
+	UNUSED(N);
+	UNUSED(x);
+#endif
+}
+
+
+/*
+ * Sum N floats over all processes into process 0.
+ */
+void mpi_reduce_sum(long N, float* x)
+{
+#ifdef USE_MPI
+	if (1 == mpi_get_size())
+		return;
+
+	bool root = (0 == mpi_get_rank());
+
+	for (long i = 0; i < N; i += INT_MAX)
+		MPI_Reduce(root ? MPI_IN_PLACE : x + i, root ? x + i : NULL, (int)MIN(N - i, (long)INT_MAX), MPI_FLOAT, MPI_SUM, 0, MPI_COMM_WORLD);
+#else
+	UNUSED(N);
+	UNUSED(x);
+#endif
+}
+
@@ -0,0 +1,19 @@
+/* Copyright 2026. The Regents of the University of California.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void mpi_init(int* argc, char*** argv);
+extern void mpi_finalize(void);
+extern int mpi_get_rank(void);
+extern int mpi_get_size(void);
+extern void mpi_allreduce_sum(long N, float* x);
+extern void mpi_reduce_sum(long N, float* x);
+
+#ifdef __cplusplus
+}
+#endif
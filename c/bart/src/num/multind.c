@@ -30,6 +30,7 @@
 
 #include "misc/misc.h"
 #include "misc/debug.h"
+#include "misc/trace.h"
 
 #include "num/optimize.h"
 #ifdef USE_CUDA
@@ -39,6 +40,9 @@
 #include "multind.h"
 
 
+extern bool num_auto_parallelize; // see flpmath.c
+
+
 
 
 
@@ -70,8 +74,8 @@ void md_nary(unsigned int C, unsigned int D, const long dim[D], const long* str[
 /**
  * Generic functions which loops over all dimensions of a set of
  * multi-dimensional arrays and calls a given function for each position.
- * This functions tries to parallelize over the dimensions indicated
- * with flags.
+ * The dimensions indicated with flags are collapsed into one loop
+ * which is parallelized.
  */
 void md_parallel_nary(unsigned int C, unsigned int D, const long dim[D], unsigned int flags, const long* str[C], void* ptr[C], void* data, md_nary_fun_t fun)
 {
@@ -81,27 +85,55 @@ void md_parallel_nary(unsigned int C, unsigned int D, const long dim[D], unsigne
 		return;
 	}
 
-	int b = ffs(flags & -flags) - 1;
-	assert(MD_IS_SET(flags, b));
+	long dimc[D];
+	md_select_dims(D, ~flags, dimc, dim);
 
-	flags = MD_CLEAR(flags, b);
+	unsigned int P = 0;
+	long pdims[D];
+	long pstrs[C][D];
+	long total = 1;
 
-	long dimc[D];
-	md_select_dims(D, ~MD_BIT(b), dimc, dim);
+	for (unsigned int i = 0; i < D; i++) {
+
+		if (MD_IS_SET(flags, i)) {
+
+			pdims[P] = dim[i];
+
+			for (unsigned int j = 0; j < C; j++)
+				pstrs[j][P] = str[j][i];
+
+			total *= dim[i];
+			P++;
+		}
+	}
+
+	debug_printf(DP_DEBUG4, "Parallelize: %ld\n", total);
 
-	debug_printf(DP_DEBUG4, "Parallelize: %d\n", dim[b]);
+	// The static schedule gives each thread the same contiguous
+	// part of the arrays in every call. Pages are placed on the
+	// NUMA node of the thread which touches them first, so clearing
+	// or copying in parallel keeps later accesses local.
 
-	// FIXME: this probably doesn't nest
-	// (maybe collect all parallelizable dims into one giant loop?)
-	#pragma omp parallel for
-	for (long i = 0; i < dim[b]; i++) {
+	#pragma omp parallel for schedule(static)
+	for (long k = 0; k < total; k++) {
 
 		void* moving_ptr[C];
 
 		for (unsigned int j = 0; j < C; j++)
-			moving_ptr[j] = ptr[j] + i * str[j][b];
+			moving_ptr[j] = ptr[j];
 
-		md_parallel_nary(C, D, dimc, flags, str, moving_ptr, data, fun);
+		long r = k;
+
+		for (unsigned int p = 0; p < P; p++) {
+
+			long i = r % pdims[p];
+			r /= pdims[p];
+
+			for (unsigned int j = 0; j < C; j++)
+				moving_ptr[j] += i * pstrs[j][p];
+		}
+
+		md_nary(C, D, dimc, str, moving_ptr, data, fun);
 	}
 }
 
@@ -392,6 +424,21 @@ void md_min_dims(unsigned int D, unsigned long flags, long odims[D], const long
 
 
 
+/*
+ * Parallel dimensions must be outside of the contiguous block
+ * processed by the kernel. Returns the flags relative to the block.
+ * (same as in optimized_twoop)
+ */
+static unsigned int parallel_skip(unsigned int flags, int* skip)
+{
+	while ((0 != flags) && (ffs(flags) <= *skip))
+		(*skip)--;
+
+	return flags >> *skip;
+}
+
+
+
 struct data_s {
 
 	size_t size;
@@ -420,14 +467,42 @@ static void nary_clear(void* _data, void* ptr[])
  */
 void md_clear2(unsigned int D, const long dim[D], const long str[D], void* ptr, size_t size)
 {
-	int skip = md_calc_blockdim(D, dim, str, size);
+	TRACE_BEGIN();
+
+	long tdims[D];
+	long tstr[D];
+
+	md_copy_dims(D, tdims, dim);
+	md_copy_strides(D, tstr, str);
+
+	long (*nstr2[1])[D] = { &tstr };
+	size_t sizes[1] = { size };
+	int ND = D;
+	unsigned int flags = 0;
+
+#ifdef  USE_CUDA
+	bool parallel = num_auto_parallelize && !cuda_ondevice(ptr);
+#else
+	bool parallel = num_auto_parallelize;
+#endif
+	// clear in parallel for first-touch placement (see md_parallel_nary)
+	if (parallel)
+		ND = tile_dims(1, optimize_dims(1, D, tdims, nstr2), D, tdims, nstr2, sizes);
+
+	int skip = md_calc_blockdim(ND, tdims, tstr, size);
 //	printf("CLEAR skip %d\n", skip);
+
+	if (parallel)
+		flags = parallel_skip(dims_parallel(1, 1, ND, tdims, nstr2, sizes), &skip);
+
 #ifdef  USE_CUDA
-	struct data_s data = { md_calc_size(skip, dim) * size, cuda_ondevice(ptr) };
+	struct data_s data = { md_calc_size(skip, tdims) * size, cuda_ondevice(ptr) };
 #else
-	struct data_s data = { md_calc_size(skip, dim) * size };
+	struct data_s data = { md_calc_size(skip, tdims) * size };
 #endif
-	md_nary(1, D - skip, dim + skip, (const long*[1]){ str + skip }, (void*[1]){ ptr }, (void*)&data, &nary_clear);
+	md_parallel_nary(1, ND - skip, tdims + skip, flags, (const long*[1]){ tstr + skip }, (void*[1]){ ptr }, (void*)&data, &nary_clear);
+
+	TRACE_END(0., md_calc_size(D, dim) * (double)size, "md_clear");
 }
 
 
@@ -522,6 +597,8 @@ void md_copy2(unsigned int D, const long dim[D], const long ostr[D], void* optr,
 		fft2(D, dim, 0, ostr, optr, istr, iptr);
 #endif
 
+	TRACE_BEGIN();
+
 	long tostr[D];
 	long tistr[D];
 	long tdims[D];
@@ -533,8 +610,22 @@ void md_copy2(unsigned int D, const long dim[D], const long ostr[D], void* optr,
 	long (*nstr2[2])[D] = { &tostr, &tistr };
 	int ND = optimize_dims(2, D, tdims, nstr2);
 	size_t sizes[2] = { size, size };
+
+#ifdef  USE_CUDA
+	bool parallel = num_auto_parallelize && !(cuda_ondevice(optr) || cuda_ondevice(iptr));
+#else
+	bool parallel = num_auto_parallelize;
+#endif
+	if (parallel)
+		ND = tile_dims(2, ND, D, tdims, nstr2, sizes);
+
 	int skip = min_blockdim(2, ND, tdims, nstr2, sizes); 
 
+	unsigned int flags = 0;
+
+	if (parallel)
+		flags = parallel_skip(dims_parallel(2, 1, ND, tdims, nstr2, sizes), &skip);
+
 	const long* nstr[2] = { *nstr2[0] + skip, *nstr2[1] + skip };
 
 	void* nptr[2] = { optr, (void*)iptr };
@@ -552,6 +643,8 @@ void md_copy2(unsigned int D, const long dim[D], const long ostr[D], void* optr,
 
 		skip++;
 		md_nary(2, ND - skip, tdims + skip , nstr, nptr, (void*)&data, &nary_strided_copy);
+
+		TRACE_END(0., 2. * md_calc_size(D, dim) * size, "md_copy");
 		return;
 	}
 #endif
@@ -559,7 +652,9 @@ void md_copy2(unsigned int D, const long dim[D], const long ostr[D], void* optr,
 	struct data_s data = { md_calc_size(skip, tdims) * size };
 #endif
 
-	md_nary(2, ND - skip, tdims + skip, nstr, nptr, (void*)&data, &nary_copy);
+	md_parallel_nary(2, ND - skip, tdims + skip, flags, nstr, nptr, (void*)&data, &nary_copy);
+
+	TRACE_END(0., 2. * md_calc_size(D, dim) * size, "md_copy");
 }
 
 
@@ -22,6 +22,7 @@
 
 #include "misc/misc.h"
 #include "misc/debug.h"
+#include "misc/trace.h"
 
 #include "ops.h"
 
@@ -576,7 +577,9 @@ const struct operator_s* operator_stack(unsigned int D, unsigned int E, const st
 
 void operator_generic_apply_unchecked(const struct operator_s* op, unsigned int N, void* args[N])
 {
+	TRACE_BEGIN();
 	op->apply((void*)op->data, N, args);
+	TRACE_END(0., 0., "operator_apply");
 }
 
 
@@ -626,7 +629,9 @@ void operator_p_apply(const struct operator_p_s* op, float mu, unsigned int IN,
 
 void operator_p_apply_unchecked(const struct operator_p_s* op, float mu, complex float* dst, const complex float* src)
 {
+	TRACE_BEGIN();
 	op->op.apply(op->op.data, 3, (void*[3]){ &mu, (void*)dst, (void*)src });
+	TRACE_END(0., 0., "operator_p_apply");
 }
 
 
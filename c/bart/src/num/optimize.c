@@ -17,6 +17,11 @@
 #include <math.h>
 
 #include <stdio.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "misc/misc.h"
 #include "misc/debug.h"
@@ -446,37 +451,160 @@ static unsigned int parallelizable(unsigned int D, unsigned int io, unsigned int
 }
 
 
-#define CHUNK (32 * 1024)
-#define CORES (64)
+/*
+ * Size of the L2 cache of a core. This is the smallest amount
+ * of memory a parallelized operation gives to a thread.
+ */
+static long detect_cache_size(void)
+{
+	long size = -1;
+
+#ifdef _SC_LEVEL2_CACHE_SIZE
+	size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+
+	if (size <= 0) {
+
+		FILE* fp = fopen("/sys/devices/system/cpu/cpu0/cache/index2/size", "r");
+
+		if (NULL != fp) {
+
+			long val;
+			char unit = 'K';
+
+			if (fscanf(fp, "%ld%c", &val, &unit) >= 1)
+				size = val * (('M' == unit) ? (1024 * 1024) : 1024);
+
+			fclose(fp);
+		}
+	}
+
+	if (size <= 0)
+		size = 256 * 1024;
+
+	debug_printf(DP_DEBUG3, "L2 cache size: %ld\n", size);
+
+	return size;
+}
+
+static long cache_size = 0;
+
+static long parallel_threads(void)
+{
+#ifdef _OPENMP
+	return omp_in_parallel() ? 1 : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+// elements which fill the L2 cache
+static long parallel_chunk(unsigned int D, size_t size[D])
+{
+	if (0 == cache_size) {
+
+		#pragma omp critical
+		if (0 == cache_size)
+			cache_size = detect_cache_size();
+	}
+
+	long bytes = 0;
+
+	for (unsigned int d = 0; d < D; d++)
+		bytes += size[d];
+
+	return MAX(1L, cache_size / bytes);
+}
+
+
+/**
+ * split the outermost dimension into tiles
+ *
+ * Without this, the dimensions of contiguous arrays are merged into
+ * one which cannot be parallelized. Splits off as many tiles as needed
+ * for a few per thread, each at least the L2 cache size.
+ * Returns the new number of dimensions (at most N).
+ */
+unsigned int tile_dims(unsigned int D, unsigned int ND, unsigned int N, long dims[N], long (*strs[D])[N], size_t size[D])
+{
+	long threads = parallel_threads();
+
+	if ((1 == threads) || (0 == ND) || (ND >= N))
+		return ND;
+
+	unsigned int i = ND - 1;
+	long L = dims[i];
+
+	long chunk = parallel_chunk(D, size);
+	long inner = md_calc_size(i, dims);
+
+	if ((L >= 4 * threads) && (inner >= chunk))
+		return ND;
+
+	// smallest number of tiles for 4 per thread, or less if too small
+
+	long tiles = 0;
+
+	for (long f = 2; (f <= L) && (inner * (L / f) >= chunk); f++) {
+
+		if (0 != L % f)
+			continue;
+
+		tiles = f;
+
+		if (f >= 4 * threads)
+			break;
+	}
+
+	if (0 == tiles)
+		return ND;
+
+	dims[i] = L / tiles;
+	dims[i + 1] = tiles;
+
+	for (unsigned int d = 0; d < D; d++)
+		(*strs[d])[i + 1] = (*strs[d])[i] * dims[i];
+
+	return ND + 1;
+}
 
 
 /**
  * compute set of dimensions to parallelize
  *
+ * Outer dimensions are added until there are a few iterations
+ * for each thread, as long as an iteration still touches at least
+ * the L2 cache size. md_parallel_nary collapses them into one loop.
  */
 unsigned int dims_parallel(unsigned int D, unsigned int io, unsigned int N, const long dims[N], long (*strs[D])[N], size_t size[D])
 {
+	long threads = parallel_threads();
+
+	if (1 == threads)
+		return 0;
+
 	unsigned int flags = parallelizable(D, io, N, dims, strs, size);
 
-	unsigned int i = D;
-	unsigned int count = 1;
+	long chunk = parallel_chunk(D, size);
+
+	unsigned int i = N;
+	long count = 1;
 
 	long reps = md_calc_size(N, dims);
 
 	unsigned int oflags = 0;
 
-	while ((count < CORES) && (i-- > 0)) {
+	while ((count < 4 * threads) && (i-- > 0)) {
 
 		if (MD_IS_SET(flags, i)) {
 
-			reps /= dims[i];
-
-			if (reps < CHUNK)
+			if (reps / dims[i] < chunk)
 				break;
 
-			oflags = MD_SET(oflags, i);
+			reps /= dims[i];
+			count *= dims[i];
 
-			//break; // only 1
+			oflags = MD_SET(oflags, i);
 		}
 	}
 
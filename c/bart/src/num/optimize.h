@@ -13,6 +13,7 @@ extern void merge_dims(unsigned int D, unsigned int N, long dims[N], long (*ostr
 extern unsigned int remove_empty_dims(unsigned int D, unsigned int N, long dims[N], long (*ostrs[D])[N]);
 extern unsigned int optimize_dims(unsigned int D, unsigned int N, long dims[N], long (*strs[D])[N]);
 extern unsigned int min_blockdim(unsigned int D, unsigned int N, const long dims[N], long (*strs[D])[N], size_t size[D]);
+extern unsigned int tile_dims(unsigned int D, unsigned int ND, unsigned int N, long dims[N], long (*strs[D])[N], size_t size[D]);
 extern unsigned int dims_parallel(unsigned int D, unsigned int io, unsigned int N, const long dims[N], long (*strs[D])[N], size_t size[D]);
 
 
@@ -152,6 +152,61 @@ static void xpay(long N, float beta, float* dst, const float* src)
 //		dst[i] = fmaf(beta, dst[i], src[i]);
 }
 
+/*
+ * Fused operations for the iterative algorithms, which compute
+ * the same as the corresponding sequence of operations above
+ * in a single pass.
+ */
+static double axpy_dot(long N, float* dst, float alpha, const float* src)
+{
+	double res = 0.;
+
+	for (long i = 0; i < N; i++) {
+
+		if (0. != alpha)
+			dst[i] += alpha * src[i];
+
+		res += src[i] * dst[i];
+	}
+
+	return res;
+}
+
+static double axpy_norm(long N, float* dst, float alpha, const float* src)
+{
+	double res = 0.;
+
+	for (long i = 0; i < N; i++) {
+
+		if (0. != alpha)
+			dst[i] += alpha * src[i];
+
+		res += dst[i] * dst[i];
+	}
+
+	return sqrt(res);
+}
+
+static void axpy_xpay(long N, float* dst, float alpha, float* x, float beta, const float* y)
+{
+	for (long i = 0; i < N; i++) {
+
+		if (0. != alpha)
+			dst[i] += alpha * x[i];
+
+		x[i] = x[i] * beta + y[i];
+	}
+}
+
+static void dual_resid(long N, float* u, float* r, const float* g, const float* z)
+{
+	for (long i = 0; i < N; i++) {
+
+		u[i] = g[i] - z[i];
+		r[i] = z[i] - u[i];
+	}
+}
+
 static void smul(long N, float alpha, float* dst, const float* src)
 {
 	for (long i = 0; i < N; i++)
@@ -520,6 +575,12 @@ struct vec_iter_s {
 	void (*smul)(long N, float alpha, float* a, const float* x);
 	void (*xpay)(long N, float alpha, float* a, const float* x);
 	void (*axpy)(long N, float* a, float alpha, const float* x);
+
+	// fused operations (one pass over all vectors)
+	double (*axpy_dot)(long N, float* a, float alpha, const float* x);
+	double (*axpy_norm)(long N, float* a, float alpha, const float* x);
+	void (*axpy_xpay)(long N, float* a, float alpha, float* x, float beta, const float* y);
+	void (*dual_resid)(long N, float* u, float* r, const float* g, const float* z);
 };
 
 
@@ -538,6 +599,11 @@ const struct vec_iter_s cpu_iter_ops = {
 	.add = add,
 	.sub = sub,
 	.swap = swap,
+
+	.axpy_dot = axpy_dot,
+	.axpy_norm = axpy_norm,
+	.axpy_xpay = axpy_xpay,
+	.dual_resid = dual_resid,
 };
 
 
@@ -8,6 +8,9 @@
 
 extern const struct vec_ops cpu_ops;
 
+// kernels of the parallel vector operations (vecops_par.c)
+extern void vecops_par_select(const char* name);
+
 struct vec_ops {
 
 	float* (*allocate)(long N);
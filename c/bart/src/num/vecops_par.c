@@ -0,0 +1,845 @@
+/* Copyright 2026. The Regents of the University of California.
+ * All rights reserved. Use of this source code is governed by
+ * a BSD-style license which can be found in the LICENSE file.
+ *
+ * Authors:
+ * 2026 agent <agent@local>
+ *
+ *
+ * Multi-threaded and vectorized versions of the vector operations
+ * used by the iterative algorithms (cpu_iter_ops in vecops.c).
+ *
+ * Vectors are split into chunks of fixed size which are processed
+ * in parallel by OpenMP. Each chunk is processed by a kernel using
+ * AVX-512, AVX2 or plain C, which is selected at runtime depending on
+ * the CPU. Reductions accumulate in double precision within each chunk
+ * and the partial sums of the chunks are added pairwise, so the result
+ * does not depend on the number of threads.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define VECOPS_X86
+#endif
+
+#include "misc/misc.h"
+#include "misc/debug.h"
+
+#include "vecops.h"
+
+
+// floats per chunk (multiple of the vector length)
+#define CHUNK 16384L
+
+// partial sums kept on the stack
+#define MAX_STACK_CHUNKS 1024L
+
+
+struct vec_kernels_s {
+
+	const char* name;
+
+	double (*dot)(long N, const float* vec1, const float* vec2);
+	void (*axpy)(long N, float* dst, float alpha, const float* src);
+	void (*xpay)(long N, float beta, float* dst, const float* src);
+	void (*smul)(long N, float alpha, float* dst, const float* src);
+	void (*add)(long N, float* dst, const float* src1, const float* src2);
+	void (*sub)(long N, float* dst, const float* src1, const float* src2);
+
+	double (*axpy_dot)(long N, float* dst, float alpha, const float* src);
+	double (*axpy_norm2)(long N, float* dst, float alpha, const float* src);
+	void (*axpy_xpay)(long N, float* dst, float alpha, float* x, float beta, const float* y);
+	void (*dual_resid)(long N, float* u, float* r, const float* g, const float* z);
+};
+
+
+
+static double dot_generic(long N, const float* vec1, const float* vec2)
+{
+	double res = 0.;
+
+	for (long i = 0; i < N; i++)
+		res += (double)vec1[i] * (double)vec2[i];
+
+	return res;
+}
+
+static void axpy_generic(long N, float* dst, float alpha, const float* src)
+{
+	for (long i = 0; i < N; i++)
+		dst[i] += alpha * src[i];
+}
+
+static void xpay_generic(long N, float beta, float* dst, const float* src)
+{
+	for (long i = 0; i < N; i++)
+		dst[i] = dst[i] * beta + src[i];
+}
+
+static void smul_generic(long N, float alpha, float* dst, const float* src)
+{
+	for (long i = 0; i < N; i++)
+		dst[i] = alpha * src[i];
+}
+
+static void add_generic(long N, float* dst, const float* src1, const float* src2)
+{
+	for (long i = 0; i < N; i++)
+		dst[i] = src1[i] + src2[i];
+}
+
+static void sub_generic(long N, float* dst, const float* src1, const float* src2)
+{
+	for (long i = 0; i < N; i++)
+		dst[i] = src1[i] - src2[i];
+}
+
+static double axpy_dot_generic(long N, float* dst, float alpha, const float* src)
+{
+	double res = 0.;
+
+	for (long i = 0; i < N; i++) {
+
+		dst[i] += alpha * src[i];
+		res += (double)src[i] * (double)dst[i];
+	}
+
+	return res;
+}
+
+static double axpy_norm2_generic(long N, float* dst, float alpha, const float* src)
+{
+	double res = 0.;
+
+	for (long i = 0; i < N; i++) {
+
+		dst[i] += alpha * src[i];
+		res += (double)dst[i] * (double)dst[i];
+	}
+
+	return res;
+}
+
+static void axpy_xpay_generic(long N, float* dst, float alpha, float* x, float beta, const float* y)
+{
+	for (long i = 0; i < N; i++) {
+
+		dst[i] += alpha * x[i];
+		x[i] = x[i] * beta + y[i];
+	}
+}
+
+static void dual_resid_generic(long N, float* u, float* r, const float* g, const float* z)
+{
+	for (long i = 0; i < N; i++) {
+
+		u[i] = g[i] - z[i];
+		r[i] = z[i] - u[i];
+	}
+}
+
+static const struct vec_kernels_s kernels_generic = {
+
+	.name = "generic",
+	.dot = dot_generic,
+	.axpy = axpy_generic,
+	.xpay = xpay_generic,
+	.smul = smul_generic,
+	.add = add_generic,
+	.sub = sub_generic,
+	.axpy_dot = axpy_dot_generic,
+	.axpy_norm2 = axpy_norm2_generic,
+	.axpy_xpay = axpy_xpay_generic,
+	.dual_resid = dual_resid_generic,
+};
+
+
+
+#ifdef VECOPS_X86
+
+#define AVX2 __attribute__((target("avx2,fma")))
+
+AVX2 static double dot_avx2(long N, const float* vec1, const float* vec2)
+{
+	__m256d acc0 = _mm256_setzero_pd();
+	__m256d acc1 = _mm256_setzero_pd();
+
+	long i = 0;
+
+	for (; i + 8 <= N; i += 8) {
+
+		__m256 a = _mm256_loadu_ps(vec1 + i);
+		__m256 b = _mm256_loadu_ps(vec2 + i);
+
+		acc0 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(a)), _mm256_cvtps_pd(_mm256_castps256_ps128(b)), acc0);
+		acc1 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(a, 1)), _mm256_cvtps_pd(_mm256_extractf128_ps(b, 1)), acc1);
+	}
+
+	double tmp[4];
+	_mm256_storeu_pd(tmp, _mm256_add_pd(acc0, acc1));
+
+	return (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]) + dot_generic(N - i, vec1 + i, vec2 + i);
+}
+
+AVX2 static void axpy_avx2(long N, float* dst, float alpha, const float* src)
+{
+	__m256 va = _mm256_set1_ps(alpha);
+
+	long i = 0;
+
+	for (; i + 8 <= N; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(src + i), _mm256_loadu_ps(dst + i)));
+
+	axpy_generic(N - i, dst + i, alpha, src + i);
+}
+
+AVX2 static void xpay_avx2(long N, float beta, float* dst, const float* src)
+{
+	__m256 vb = _mm256_set1_ps(beta);
+
+	long i = 0;
+
+	for (; i + 8 <= N; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_fmadd_ps(_mm256_loadu_ps(dst + i), vb, _mm256_loadu_ps(src + i)));
+
+	xpay_generic(N - i, beta, dst + i, src + i);
+}
+
+AVX2 static void smul_avx2(long N, float alpha, float* dst, const float* src)
+{
+	__m256 va = _mm256_set1_ps(alpha);
+
+	long i = 0;
+
+	for (; i + 8 <= N; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(va, _mm256_loadu_ps(src + i)));
+
+	smul_generic(N - i, alpha, dst + i, src + i);
+}
+
+AVX2 static void add_avx2(long N, float* dst, const float* src1, const float* src2)
+{
+	long i = 0;
+
+	for (; i + 8 <= N; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(src1 + i), _mm256_loadu_ps(src2 + i)));
+
+	add_generic(N - i, dst + i, src1 + i, src2 + i);
+}
+
+AVX2 static void sub_avx2(long N, float* dst, const float* src1, const float* src2)
+{
+	long i = 0;
+
+	for (; i + 8 <= N; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_sub_ps(_mm256_loadu_ps(src1 + i), _mm256_loadu_ps(src2 + i)));
+
+	sub_generic(N - i, dst + i, src1 + i, src2 + i);
+}
+
+AVX2 static double axpy_dot_avx2(long N, float* dst, float alpha, const float* src)
+{
+	__m256 va = _mm256_set1_ps(alpha);
+	__m256d acc0 = _mm256_setzero_pd();
+	__m256d acc1 = _mm256_setzero_pd();
+
+	long i = 0;
+
+	for (; i + 8 <= N; i += 8) {
+
+		__m256 x = _mm256_loadu_ps(src + i);
+		__m256 d = _mm256_fmadd_ps(va, x, _mm256_loadu_ps(dst + i));
+
+		_mm256_storeu_ps(dst + i, d);
+
+		acc0 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(x)), _mm256_cvtps_pd(_mm256_castps256_ps128(d)), acc0);
+		acc1 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)), _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1)), acc1);
+	}
+
+	double tmp[4];
+	_mm256_storeu_pd(tmp, _mm256_add_pd(acc0, acc1));
+
+	return (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]) + axpy_dot_generic(N - i, dst + i, alpha, src + i);
+}
+
+AVX2 static double axpy_norm2_avx2(long N, float* dst, float alpha, const float* src)
+{
+	__m256 va = _mm256_set1_ps(alpha);
+	__m256d acc0 = _mm256_setzero_pd();
+	__m256d acc1 = _mm256_setzero_pd();
+
+	long i = 0;
+
+	for (; i + 8 <= N; i += 8) {
+
+		__m256 d = _mm256_fmadd_ps(va, _mm256_loadu_ps(src + i), _mm256_loadu_ps(dst + i));
+
+		_mm256_storeu_ps(dst + i, d);
+
+		__m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(d));
+		__m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1));
+
+		acc0 = _mm256_fmadd_pd(lo, lo, acc0);
+		acc1 = _mm256_fmadd_pd(hi, hi, acc1);
+	}
+
+	double tmp[4];
+	_mm256_storeu_pd(tmp, _mm256_add_pd(acc0, acc1));
+
+	return (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]) + axpy_norm2_generic(N - i, dst + i, alpha, src + i);
+}
+
+AVX2 static void axpy_xpay_avx2(long N, float* dst, float alpha, float* x, float beta, const float* y)
+{
+	__m256 va = _mm256_set1_ps(alpha);
+	__m256 vb = _mm256_set1_ps(beta);
+
+	long i = 0;
+
+	for (; i + 8 <= N; i += 8) {
+
+		__m256 vx = _mm256_loadu_ps(x + i);
+
+		_mm256_storeu_ps(dst + i, _mm256_fmadd_ps(va, vx, _mm256_loadu_ps(dst + i)));
+		_mm256_storeu_ps(x + i, _mm256_fmadd_ps(vx, vb, _mm256_loadu_ps(y + i)));
+	}
+
+	axpy_xpay_generic(N - i, dst + i, alpha, x + i, beta, y + i);
+}
+
+AVX2 static void dual_resid_avx2(long N, float* u, float* r, const float* g, const float* z)
+{
+	long i = 0;
+
+	for (; i + 8 <= N; i += 8) {
+
+		__m256 vz = _mm256_loadu_ps(z + i);
+		__m256 vu = _mm256_sub_ps(_mm256_loadu_ps(g + i), vz);
+
+		_mm256_storeu_ps(u + i, vu);
+		_mm256_storeu_ps(r + i, _mm256_sub_ps(vz, vu));
+	}
+
+	dual_resid_generic(N - i, u + i, r + i, g + i, z + i);
+}
+
+static const struct vec_kernels_s kernels_avx2 = {
+
+	.name = "avx2",
+	.dot = dot_avx2,
+	.axpy = axpy_avx2,
+	.xpay = xpay_avx2,
+	.smul = smul_avx2,
+	.add = add_avx2,
+	.sub = sub_avx2,
+	.axpy_dot = axpy_dot_avx2,
+	.axpy_norm2 = axpy_norm2_avx2,
+	.axpy_xpay = axpy_xpay_avx2,
+	.dual_resid = dual_resid_avx2,
+};
+
+
+
+#define AVX512 __attribute__((target("avx512f")))
+
+AVX512 static double dot_avx512(long N, const float* vec1, const float* vec2)
+{
+	__m512d acc0 = _mm512_setzero_pd();
+	__m512d acc1 = _mm512_setzero_pd();
+
+	long i = 0;
+
+	for (; i + 16 <= N; i += 16) {
+
+		acc0 = _mm512_fmadd_pd(_mm512_cvtps_pd(_mm256_loadu_ps(vec1 + i)), _mm512_cvtps_pd(_mm256_loadu_ps(vec2 + i)), acc0);
+		acc1 = _mm512_fmadd_pd(_mm512_cvtps_pd(_mm256_loadu_ps(vec1 + i + 8)), _mm512_cvtps_pd(_mm256_loadu_ps(vec2 + i + 8)), acc1);
+	}
+
+	double tmp[8];
+	_mm512_storeu_pd(tmp, _mm512_add_pd(acc0, acc1));
+
+	return ((tmp[0] + tmp[1]) + (tmp[2] + tmp[3])) + ((tmp[4] + tmp[5]) + (tmp[6] + tmp[7])) + dot_generic(N - i, vec1 + i, vec2 + i);
+}
+
+AVX512 static void axpy_avx512(long N, float* dst, float alpha, const float* src)
+{
+	__m512 va = _mm512_set1_ps(alpha);
+
+	long i = 0;
+
+	for (; i + 16 <= N; i += 16)
+		_mm512_storeu_ps(dst + i, _mm512_fmadd_ps(va, _mm512_loadu_ps(src + i), _mm512_loadu_ps(dst + i)));
+
+	axpy_generic(N - i, dst + i, alpha, src + i);
+}
+
+AVX512 static void xpay_avx512(long N, float beta, float* dst, const float* src)
+{
+	__m512 vb = _mm512_set1_ps(beta);
+
+	long i = 0;
+
+	for (; i + 16 <= N; i += 16)
+		_mm512_storeu_ps(dst + i, _mm512_fmadd_ps(_mm512_loadu_ps(dst + i), vb, _mm512_loadu_ps(src + i)));
+
+	xpay_generic(N - i, beta, dst + i, src + i);
+}
+
+AVX512 static void smul_avx512(long N, float alpha, float* dst, const float* src)
+{
+	__m512 va = _mm512_set1_ps(alpha);
+
+	long i = 0;
+
+	for (; i + 16 <= N; i += 16)
+		_mm512_storeu_ps(dst + i, _mm512_mul_ps(va, _mm512_loadu_ps(src + i)));
+
+	smul_generic(N - i, alpha, dst + i, src + i);
+}
+
+AVX512 static void add_avx512(long N, float* dst, const float* src1, const float* src2)
+{
+	long i = 0;
+
+	for (; i + 16 <= N; i += 16)
+		_mm512_storeu_ps(dst + i, _mm512_add_ps(_mm512_loadu_ps(src1 + i), _mm512_loadu_ps(src2 + i)));
+
+	add_generic(N - i, dst + i, src1 + i, src2 + i);
+}
+
+AVX512 static void sub_avx512(long N, float* dst, const float* src1, const float* src2)
+{
+	long i = 0;
+
+	for (; i + 16 <= N; i += 16)
+		_mm512_storeu_ps(dst + i, _mm512_sub_ps(_mm512_loadu_ps(src1 + i), _mm512_loadu_ps(src2 + i)));
+
+	sub_generic(N - i, dst + i, src1 + i, src2 + i);
+}
+
+AVX512 static double axpy_dot_avx512(long N, float* dst, float alpha, const float* src)
+{
+	__m512 va = _mm512_set1_ps(alpha);
+	__m512d acc0 = _mm512_setzero_pd();
+	__m512d acc1 = _mm512_setzero_pd();
+
+	long i = 0;
+
+	for (; i + 16 <= N; i += 16) {
+
+		_mm512_storeu_ps(dst + i, _mm512_fmadd_ps(va, _mm512_loadu_ps(src + i), _mm512_loadu_ps(dst + i)));
+
+		acc0 = _mm512_fmadd_pd(_mm512_cvtps_pd(_mm256_loadu_ps(src + i)), _mm512_cvtps_pd(_mm256_loadu_ps(dst + i)), acc0);
+		acc1 = _mm512_fmadd_pd(_mm512_cvtps_pd(_mm256_loadu_ps(src + i + 8)), _mm512_cvtps_pd(_mm256_loadu_ps(dst + i + 8)), acc1);
+	}
+
+	double tmp[8];
+	_mm512_storeu_pd(tmp, _mm512_add_pd(acc0, acc1));
+
+	return ((tmp[0] + tmp[1]) + (tmp[2] + tmp[3])) + ((tmp[4] + tmp[5]) + (tmp[6] + tmp[7])) + axpy_dot_generic(N - i, dst + i, alpha, src + i);
+}
+
+AVX512 static double axpy_norm2_avx512(long N, float* dst, float alpha, const float* src)
+{
+	__m512 va = _mm512_set1_ps(alpha);
+	__m512d acc0 = _mm512_setzero_pd();
+	__m512d acc1 = _mm512_setzero_pd();
+
+	long i = 0;
+
+	for (; i + 16 <= N; i += 16) {
+
+		_mm512_storeu_ps(dst + i, _mm512_fmadd_ps(va, _mm512_loadu_ps(src + i), _mm512_loadu_ps(dst + i)));
+
+		__m512d lo = _mm512_cvtps_pd(_mm256_loadu_ps(dst + i));
+		__m512d hi = _mm512_cvtps_pd(_mm256_loadu_ps(dst + i + 8));
+
+		acc0 = _mm512_fmadd_pd(lo, lo, acc0);
+		acc1 = _mm512_fmadd_pd(hi, hi, acc1);
+	}
+
+	double tmp[8];
+	_mm512_storeu_pd(tmp, _mm512_add_pd(acc0, acc1));
+
+	return ((tmp[0] + tmp[1]) + (tmp[2] + tmp[3])) + ((tmp[4] + tmp[5]) + (tmp[6] + tmp[7])) + axpy_norm2_generic(N - i, dst + i, alpha, src + i);
+}
+
+AVX512 static void axpy_xpay_avx512(long N, float* dst, float alpha, float* x, float beta, const float* y)
+{
+	__m512 va = _mm512_set1_ps(alpha);
+	__m512 vb = _mm512_set1_ps(beta);
+
+	long i = 0;
+
+	for (; i + 16 <= N; i += 16) {
+
+		__m512 vx = _mm512_loadu_ps(x + i);
+
+		_mm512_storeu_ps(dst + i, _mm512_fmadd_ps(va, vx, _mm512_loadu_ps(dst + i)));
+		_mm512_storeu_ps(x + i, _mm512_fmadd_ps(vx, vb, _mm512_loadu_ps(y + i)));
+	}
+
+	axpy_xpay_generic(N - i, dst + i, alpha, x + i, beta, y + i);
+}
+
+AVX512 static void dual_resid_avx512(long N, float* u, float* r, const float* g, const float* z)
+{
+	long i = 0;
+
+	for (; i + 16 <= N; i += 16) {
+
+		__m512 vz = _mm512_loadu_ps(z + i);
+		__m512 vu = _mm512_sub_ps(_mm512_loadu_ps(g + i), vz);
+
+		_mm512_storeu_ps(u + i, vu);
+		_mm512_storeu_ps(r + i, _mm512_sub_ps(vz, vu));
+	}
+
+	dual_resid_generic(N - i, u + i, r + i, g + i, z + i);
+}
+
+static const struct vec_kernels_s kernels_avx512 = {
+
+	.name = "avx512",
+	.dot = dot_avx512,
+	.axpy = axpy_avx512,
+	.xpay = xpay_avx512,
+	.smul = smul_avx512,
+	.add = add_avx512,
+	.sub = sub_avx512,
+	.axpy_dot = axpy_dot_avx512,
+	.axpy_norm2 = axpy_norm2_avx512,
+	.axpy_xpay = axpy_xpay_avx512,
+	.dual_resid = dual_resid_avx512,
+};
+
+#endif
+
+
+
+static const struct vec_kernels_s* kern = &kernels_generic;
+
+
+/**
+ * Select the kernels: "generic", "avx2" or "avx512", or the
+ * best supported by the CPU if name is NULL or not supported.
+ */
+void vecops_par_select(const char* name)
+{
+	kern = &kernels_generic;
+
+#ifdef VECOPS_X86
+	__builtin_cpu_init();
+
+	bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	bool avx512 = __builtin_cpu_supports("avx512f");
+
+	bool generic = (NULL != name) && (0 == strcmp(name, "generic"));
+	bool only_avx2 = (NULL != name) && (0 == strcmp(name, "avx2"));
+
+	if (avx2 && !generic)
+		kern = (avx512 && !only_avx2) ? &kernels_avx512 : &kernels_avx2;
+#else
+	UNUSED(name);
+#endif
+	debug_printf(DP_DEBUG1, "Parallel vector operations: %s kernels\n", kern->name);
+}
+
+
+
+static long nchunks(long N)
+{
+	return (N + CHUNK - 1) / CHUNK;
+}
+
+// pairwise sum, the order only depends on the number of chunks
+static double sum_pairwise(long N, const double* x)
+{
+	if (1 == N)
+		return x[0];
+
+	long H = N / 2;
+
+	return sum_pairwise(H, x) + sum_pairwise(N - H, x + H);
+}
+
+
+static double dot(long N, const float* vec1, const float* vec2)
+{
+	if (0 == N)
+		return 0.;
+
+	long C = nchunks(N);
+
+	double stack[(C <= MAX_STACK_CHUNKS) ? C : 1];
+	double* part = (C <= MAX_STACK_CHUNKS) ? stack : xmalloc(C * sizeof(double));
+
+	#pragma omp parallel for if (C > 1)
+	for (long c = 0; c < C; c++) {
+
+		long o = c * CHUNK;
+		part[c] = kern->dot(MIN(CHUNK, N - o), vec1 + o, vec2 + o);
+	}
+
+	double res = sum_pairwise(C, part);
+
+	if (part != stack)
+		free(part);
+
+	return res;
+}
+
+static double norm(long N, const float* vec)
+{
+	return sqrt(dot(N, vec, vec));
+}
+
+
+static void axpy(long N, float* dst, float alpha, const float* src)
+{
+	if (0. == alpha)
+		return;
+
+	long C = nchunks(N);
+
+	#pragma omp parallel for if (C > 1)
+	for (long c = 0; c < C; c++) {
+
+		long o = c * CHUNK;
+		kern->axpy(MIN(CHUNK, N - o), dst + o, alpha, src + o);
+	}
+}
+
+static void xpay(long N, float beta, float* dst, const float* src)
+{
+	long C = nchunks(N);
+
+	#pragma omp parallel for if (C > 1)
+	for (long c = 0; c < C; c++) {
+
+		long o = c * CHUNK;
+		kern->xpay(MIN(CHUNK, N - o), beta, dst + o, src + o);
+	}
+}
+
+static void smul(long N, float alpha, float* dst, const float* src)
+{
+	long C = nchunks(N);
+
+	#pragma omp parallel for if (C > 1)
+	for (long c = 0; c < C; c++) {
+
+		long o = c * CHUNK;
+		kern->smul(MIN(CHUNK, N - o), alpha, dst + o, src + o);
+	}
+}
+
+static void add(long N, float* dst, const float* src1, const float* src2)
+{
+	long C = nchunks(N);
+
+	#pragma omp parallel for if (C > 1)
+	for (long c = 0; c < C; c++) {
+
+		long o = c * CHUNK;
+		kern->add(MIN(CHUNK, N - o), dst + o, src1 + o, src2 + o);
+	}
+}
+
+static void sub(long N, float* dst, const float* src1, const float* src2)
+{
+	long C = nchunks(N);
+
+	#pragma omp parallel for if (C > 1)
+	for (long c = 0; c < C; c++) {
+
+		long o = c * CHUNK;
+		kern->sub(MIN(CHUNK, N - o), dst + o, src1 + o, src2 + o);
+	}
+}
+
+static double axpy_dot(long N, float* dst, float alpha, const float* src)
+{
+	if (0 == N)
+		return 0.;
+
+	long C = nchunks(N);
+
+	double stack[(C <= MAX_STACK_CHUNKS) ? C : 1];
+	double* part = (C <= MAX_STACK_CHUNKS) ? stack : xmalloc(C * sizeof(double));
+
+	#pragma omp parallel for if (C > 1)
+	for (long c = 0; c < C; c++) {
+
+		long o = c * CHUNK;
+		part[c] = kern->axpy_dot(MIN(CHUNK, N - o), dst + o, alpha, src + o);
+	}
+
+	double res = sum_pairwise(C, part);
+
+	if (part != stack)
+		free(part);
+
+	return res;
+}
+
+static double axpy_norm(long N, float* dst, float alpha, const float* src)
+{
+	if (0 == N)
+		return 0.;
+
+	long C = nchunks(N);
+
+	double stack[(C <= MAX_STACK_CHUNKS) ? C : 1];
+	double* part = (C <= MAX_STACK_CHUNKS) ? stack : xmalloc(C * sizeof(double));
+
+	#pragma omp parallel for if (C > 1)
+	for (long c = 0; c < C; c++) {
+
+		long o = c * CHUNK;
+		part[c] = kern->axpy_norm2(MIN(CHUNK, N - o), dst + o, alpha, src + o);
+	}
+
+	double res = sum_pairwise(C, part);
+
+	if (part != stack)
+		free(part);
+
+	return sqrt(res);
+}
+
+static void axpy_xpay(long N, float* dst, float alpha, float* x, float beta, const float* y)
+{
+	long C = nchunks(N);
+
+	#pragma omp parallel for if (C > 1)
+	for (long c = 0; c < C; c++) {
+
+		long o = c * CHUNK;
+		kern->axpy_xpay(MIN(CHUNK, N - o), dst + o, alpha, x + o, beta, y + o);
+	}
+}
+
+static void dual_resid(long N, float* u, float* r, const float* g, const float* z)
+{
+	long C = nchunks(N);
+
+	#pragma omp parallel for if (C > 1)
+	for (long c = 0; c < C; c++) {
+
+		long o = c * CHUNK;
+		kern->dual_resid(MIN(CHUNK, N - o), u + o, r + o, g + o, z + o);
+	}
+}
+
+static void copy(long N, float* dst, const float* src)
+{
+	long C = nchunks(N);
+
+	#pragma omp parallel for if (C > 1)
+	for (long c = 0; c < C; c++) {
+
+		long o = c * CHUNK;
+		memcpy(dst + o, src + o, MIN(CHUNK, N - o) * sizeof(float));
+	}
+}
+
+static void clear(long N, float* vec)
+{
+	long C = nchunks(N);
+
+	#pragma omp parallel for if (C > 1)
+	for (long c = 0; c < C; c++) {
+
+		long o = c * CHUNK;
+		memset(vec + o, 0, MIN(CHUNK, N - o) * sizeof(float));
+	}
+}
+
+static void swap(long N, float* a, float* b)
+{
+	long C = nchunks(N);
+
+	#pragma omp parallel for if (C > 1)
+	for (long c = 0; c < C; c++) {
+
+		long o = c * CHUNK;
+		long n = MIN(CHUNK, N - o);
+
+		for (long i = o; i < o + n; i++) {
+
+			float tmp = a[i];
+			a[i] = b[i];
+			b[i] = tmp;
+		}
+	}
+}
+
+
+static float* allocate(long N)
+{
+	assert(N >= 0);
+	return xmalloc((size_t)N * sizeof(float));
+}
+
+static void del(float* vec)
+{
+	free(vec);
+}
+
+
+
+// defined in iter/vec.h
+struct vec_iter_s {
+
+	float* (*allocate)(long N);
+	void (*del)(float* x);
+	void (*clear)(long N, float* x);
+	void (*copy)(long N, float* a, const float* x);
+	void (*swap)(long N, float* a, float* x);
+
+	double (*norm)(long N, const float* x);
+	double (*dot)(long N, const float* x, const float* y);
+
+	void (*sub)(long N, float* a, const float* x, const float* y);
+	void (*add)(long N, float* a, const float* x, const float* y);
+
+	void (*smul)(long N, float alpha, float* a, const float* x);
+	void (*xpay)(long N, float alpha, float* a, const float* x);
+	void (*axpy)(long N, float* a, float alpha, const float* x);
+
+	// fused operations (one pass over all vectors)
+	double (*axpy_dot)(long N, float* a, float alpha, const float* x);
+	double (*axpy_norm)(long N, float* a, float alpha, const float* x);
+	void (*axpy_xpay)(long N, float* a, float alpha, float* x, float beta, const float* y);
+	void (*dual_resid)(long N, float* u, float* r, const float* g, const float* z);
+};
+
+
+extern const struct vec_iter_s cpu_par_iter_ops;
+const struct vec_iter_s cpu_par_iter_ops = {
+
+	.allocate = allocate,
+	.del = del,
+	.clear = clear,
+	.copy = copy,
+	.dot = dot,
+	.norm = norm,
+	.axpy = axpy,
+	.xpay = xpay,
+	.smul = smul,
+	.add = add,
+	.sub = sub,
+	.swap = swap,
+
+	.axpy_dot = axpy_dot,
+	.axpy_norm = axpy_norm,
+	.axpy_xpay = axpy_xpay,
+	.dual_resid = dual_resid,
+};
+